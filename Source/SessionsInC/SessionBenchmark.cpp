@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SessionBenchmark.h"
+#include "SessionsInC.h"
+#include "Misc/App.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+
+FSessionBenchmarkReport::FSessionBenchmarkReport(const FString& InName)
+	: Name(InName)
+	, Writer(TJsonWriterFactory<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>::Create(&Json))
+{
+	Writer->WriteObjectStart();
+	Writer->WriteValue(TEXT("Build"), FString(FApp::GetBuildVersion()));
+	Writer->WriteValue(TEXT("Changelist"), static_cast<int32>(FEngineVersion::Current().GetChangelist()));
+}
+
+bool FSessionBenchmarkReport::Save()
+{
+	Writer->WriteObjectEnd();
+	Writer->Close();
+
+	const FString Filename = FPaths::ProjectSavedDir() / TEXT("Benchmarks")
+		/ FString::Printf(TEXT("%s_%s.json"), *Name, *FDateTime::Now().ToString());
+
+	if (false == FFileHelper::SaveStringToFile(Json, *Filename))
+	{
+		UE_LOG(LogSessionsInC, Error, TEXT("%s: can't write %s"), *Name, *Filename);
+		return false;
+	}
+
+	UE_LOG(LogSessionsInC, Log, TEXT("%s: report written to %s"), *Name, *Filename);
+	return true;
+}
+
+FSessionBenchmarkPhases::~FSessionBenchmarkPhases()
+{
+	Stop();
+}
+
+void FSessionBenchmarkPhases::Start(int32 InNumPhases, float InPhaseSeconds, float InSettleSeconds)
+{
+	Stop();
+
+	NumPhases = FMath::Max(1, InNumPhases);
+	PhaseSeconds = FMath::Max(0.1f, InPhaseSeconds);
+	SettleSeconds = FMath::Max(0.f, InSettleSeconds);
+
+	Phase = 0;
+	PhaseElapsed = 0.f;
+	bMeasuring = false;
+	Stats = FSessionBenchmarkPhaseStats();
+
+	TickHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FSessionBenchmarkPhases::Tick));
+}
+
+void FSessionBenchmarkPhases::Stop()
+{
+	if (TickHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(TickHandle);
+		TickHandle.Reset();
+	}
+
+	Phase = INDEX_NONE;
+}
+
+bool FSessionBenchmarkPhases::Tick(float DeltaTime)
+{
+	PhaseElapsed += DeltaTime;
+	if (PhaseElapsed < SettleSeconds)
+		return true;
+
+	if (false == bMeasuring)
+	{
+		bMeasuring = true;
+		if (OnPhaseMeasureStart)
+		{
+			OnPhaseMeasureStart(Phase);
+		}
+		return true;
+	}
+
+	// Busy game thread time of the last frame, without the idle wait
+	Stats.Seconds += DeltaTime;
+	Stats.BusyCycles += GGameThreadTime;
+	++Stats.Frames;
+
+	if (Stats.Seconds < PhaseSeconds)
+		return true;
+
+	const int32 MeasuredPhase = Phase;
+	const FSessionBenchmarkPhaseStats MeasuredStats = Stats;
+
+	PhaseElapsed = 0.f;
+	bMeasuring = false;
+	Stats = FSessionBenchmarkPhaseStats();
+
+	const bool bFinished = ++Phase >= NumPhases;
+	if (bFinished)
+	{
+		TickHandle.Reset();
+		Phase = INDEX_NONE;
+	}
+
+	if (OnPhaseMeasured)
+	{
+		OnPhaseMeasured(MeasuredPhase, MeasuredStats);
+	}
+
+	return false == bFinished;
+}
@@ -0,0 +1,86 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Serialization/JsonWriter.h"
+#include "Policies/PrettyJsonPrintPolicy.h"
+
+/**
+*	JSON report of a benchmark run, written to Saved/Benchmarks/<Name>_<date>.json.
+*	The body only holds the build and the results, the date is kept in the file name so reports of different builds diff cleanly.
+*/
+class FSessionBenchmarkReport
+{
+public:
+	typedef TJsonWriter<TCHAR, TPrettyJsonPrintPolicy<TCHAR>> FWriter;
+
+	/** Opens the root object and writes the build header */
+	FSessionBenchmarkReport(const FString& InName);
+
+	/** Writer positioned inside the root object */
+	FWriter& GetWriter() const { return *Writer; }
+
+	/** Closes the root object and saves the report */
+	bool Save();
+
+private:
+	FString Name;
+	FString Json;
+	TSharedRef<FWriter> Writer;
+};
+
+/** Frame statistics of one measured benchmark phase */
+struct FSessionBenchmarkPhaseStats
+{
+	double Seconds = 0.0;
+	uint64 BusyCycles = 0;
+	int32 Frames = 0;
+
+	/** Wall time per frame, including the idle wait of the frame rate cap */
+	double GetFrameMs() const { return Frames > 0 ? 1000.0 * Seconds / Frames : 0.0; }
+
+	/** Busy game thread time per frame */
+	double GetBusyMs() const { return Frames > 0 ? FPlatformTime::ToMilliseconds64(BusyCycles) / Frames : 0.0; }
+
+	/** Busy game thread time per second of wall time */
+	double GetCoreUtilization() const { return Seconds > 0.0 ? FPlatformTime::ToSeconds64(BusyCycles) / Seconds : 0.0; }
+};
+
+/**
+*	Runs a fixed number of timed phases on the core ticker.
+*	Every phase first settles for SettleSeconds, then measures the frames for PhaseSeconds.
+*	The owner switches the measured feature on and off from the callbacks.
+*/
+class FSessionBenchmarkPhases
+{
+public:
+	~FSessionBenchmarkPhases();
+
+	/** Called when a phase starts measuring, after settling */
+	TFunction<void(int32 Phase)> OnPhaseMeasureStart;
+
+	/** Called when a phase has been measured, set up the next phase here. The last call comes after the runner stopped. */
+	TFunction<void(int32 Phase, const FSessionBenchmarkPhaseStats& Stats)> OnPhaseMeasured;
+
+	void Start(int32 InNumPhases, float InPhaseSeconds, float InSettleSeconds = 0.f);
+	void Stop();
+
+	bool IsRunning() const { return TickHandle.IsValid(); }
+	int32 GetPhase() const { return Phase; }
+
+private:
+	bool Tick(float DeltaTime);
+
+	int32 NumPhases = 0;
+	float PhaseSeconds = 0.f;
+	float SettleSeconds = 0.f;
+
+	int32 Phase = INDEX_NONE;
+	float PhaseElapsed = 0.f;
+	bool bMeasuring = false;
+	FSessionBenchmarkPhaseStats Stats;
+
+	FTSTicker::FDelegateHandle TickHandle;
+};
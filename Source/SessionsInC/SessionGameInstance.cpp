@@ -2,8 +2,14 @@
 
 
 #include "SessionGameInstance.h"
+#include "SessionReplayRecorder.h"
+#include "SessionNetBenchmark.h"
+#include "SessionMemoryReport.h"
+#include "SessionMatchServer.h"
+#include "SessionBenchmark.h"
 #include "OnlineSessionSettings.h"
 #include "Online/OnlineSessionNames.h"
+#include "SessionsInCGameMode.h"
 
 USessionGameInstance::USessionGameInstance(const FObjectInitializer& ObjectInitializer)
 {
@@ -16,10 +22,15 @@ USessionGameInstance::USessionGameInstance(const FObjectInitializer& ObjectIniti
 
 	/** Bind function for JOINING a Session */
 	OnJoinSessionCompleteDelegate = FOnJoinSessionCompleteDelegate::CreateUObject(this, &USessionGameInstance::OnJoinSessionComplete);
+
+	/** Bind function for DESTROYING a Session */
+	OnDestroySessionCompleteDelegate = FOnDestroySessionCompleteDelegate::CreateUObject(this, &USessionGameInstance::OnDestroySessionComplete);
 }
 
-bool USessionGameInstance::HostSession(TSharedPtr<const FUniqueNetId> UserId, FName SessionName, bool bIsLAN, bool bIsPresence, int32 MaxNumPlayers)
+bool USessionGameInstance::HostSession(TSharedPtr<const FUniqueNetId> UserId, FName SessionName, bool bIsLAN, bool bIsPresence, int32 MaxNumPlayers, bool bRecordReplay)
 {
+	LLM_SCOPE_BYTAG(SessionsInC_Session);
+
 	// Get the Online Subsystem to work with
 	IOnlineSubsystem* const OnlineSub = IOnlineSubsystem::Get();
 
@@ -59,6 +70,9 @@ bool USessionGameInstance::HostSession(TSharedPtr<const FUniqueNetId> UserId, FN
 
 			SessionSettings->Set(SETTING_MAPNAME, FString("ThirdPersonMap"), EOnlineDataAdvertisementType::ViaOnlineService);
 
+			// Recording starts in OnStartOnlineGameComplete, once the session is actually running
+			bPendingReplayRecording = bRecordReplay;
+
 			// Set the delegate to the Handle of the SessionInterface
 			OnCreateSessionCompleteDelegateHandle = Sessions->AddOnCreateSessionCompleteDelegate_Handle(OnCreateSessionCompleteDelegate);
 
@@ -121,6 +135,10 @@ void USessionGameInstance::OnStartOnlineGameComplete(FName SessionName, bool bWa
 		}
 	}
 
+	// Consumed by this start whatever happens below
+	const bool bRecordReplay = bPendingReplayRecording;
+	bPendingReplayRecording = false;
+
 	FString strMapName;
 	if (false == Sessions->GetSessionSettings(SessionName)->Get(SETTING_MAPNAME, strMapName))
 	{
@@ -132,12 +150,20 @@ void USessionGameInstance::OnStartOnlineGameComplete(FName SessionName, bool bWa
 	// If the start was successful, we can open a NewMap if we want. Make sure to use "listen" as a parameter!
 	if (bWasSuccessful)
 	{
-		UGameplayStatics::OpenLevel(GetWorld(), FName(strMapName), true, "listen");
+		// The map's World Settings pick a Blueprint game mode without the late join and governor code
+		UGameplayStatics::OpenLevel(GetWorld(), FName(strMapName), true, FString::Printf(TEXT("listen?%s"), *ASessionsInCGameMode::GetGameURLOption()));
+
+		// OpenLevel only travels on the next engine tick, record from OnPostLoadMapWithWorld so the front end isn't captured
+		PendingReplaySessionName = bRecordReplay ? SessionName : NAME_None;
 	}
 }
 
 void USessionGameInstance::FindSessions(TSharedPtr<const FUniqueNetId> UserId, bool bIsLAN, bool bIsPresence)
 {
+	// Only the search object. The OSS fills SearchResults later from its own tick, outside of this scope,
+	// the copies we keep are tagged in OnFindSessionsComplete.
+	LLM_SCOPE_BYTAG(SessionsInC_Session);
+
 	// Get the OnlineSubsystem we want to work with
 	IOnlineSubsystem* OnlineSub = IOnlineSubsystem::Get();
 
@@ -181,6 +207,9 @@ void USessionGameInstance::FindSessions(TSharedPtr<const FUniqueNetId> UserId, b
 
 void USessionGameInstance::OnFindSessionsComplete(bool bWasSuccessful)
 {
+	// The Blueprint copies of the results
+	LLM_SCOPE_BYTAG(SessionsInC_Session);
+
 	GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("OFindSessionsComplete bSuccess: %d"), bWasSuccessful));
 
 	// Get OnlineSubsystem we want to work with
@@ -214,11 +243,20 @@ void USessionGameInstance::OnFindSessionsComplete(bool bWasSuccessful)
 					arrResult[SearchIdx].OnlineResult = SessionSearch->SearchResults[SearchIdx];
 				}
 
+				LastSearchResultBytes = arrResult.GetAllocatedSize();
+				for (const FBlueprintSessionResult& Result : arrResult)
+				{
+					LastSearchResultBytes += Result.OnlineResult.Session.SessionSettings.Settings.GetAllocatedSize();
+				}
+
 				OnFindSessionResult(arrResult);
 
 				if (Fuc_Dele_SessionResult.IsBound())
 					Fuc_Dele_SessionResult.Broadcast(true, arrResult);
 			}
+
+			if (NetBenchmarkRunner.IsValid())
+				NetBenchmarkRunner->OnFindSessionsComplete(bWasSuccessful);
 		}
 	}
 }
@@ -227,6 +265,8 @@ bool USessionGameInstance::JoinSession(TSharedPtr<const FUniqueNetId, ESPMode::T
 	FName SessionName,
 	const FOnlineSessionSearchResult& SearchResult)
 {
+	LLM_SCOPE_BYTAG(SessionsInC_Session);
+
 	// Return bool
 	bool bSuccessful = false;
 
@@ -282,6 +322,12 @@ void USessionGameInstance::OnJoinSessionComplete(FName SessionName, EOnJoinSessi
 				FString strIp, strPort;
 				int32 nPort = 7777;
 
+				// Matches of a multi match server listen on their own port
+				if (FNamedOnlineSession* NamedSession = Sessions->GetNamedSession(SessionName))
+				{
+					NamedSession->SessionSettings.Get(FName("SESSION_PORT"), nPort);
+				}
+
 				TravelURL.Split(TEXT(":"), &strIp, &strPort, ESearchCase::IgnoreCase, ESearchDir::FromStart);
 
 				FString NewTravelURL = FString::Printf(TEXT("%s:%d"), *strIp, nPort);
@@ -289,6 +335,9 @@ void USessionGameInstance::OnJoinSessionComplete(FName SessionName, EOnJoinSessi
 				GEngine->AddOnScreenDebugMessage(
 					-1, 10.f, FColor::Red, FString::Printf(TEXT("NewTravelURL = %s"), *NewTravelURL));
 
+				// Time-to-playable is measured from here until the new PlayerController acknowledges its pawn
+				JoinTravelStartSeconds = FPlatformTime::Seconds();
+
 				// Finally call the ClienTravel. If you want, you could print the TravelURL to see
 				// how it really looks like
 				PlayerController->ClientTravel(NewTravelURL, ETravelType::TRAVEL_Absolute);
@@ -297,6 +346,41 @@ void USessionGameInstance::OnJoinSessionComplete(FName SessionName, EOnJoinSessi
 	}
 }
 
+float USessionGameInstance::ConsumeJoinTravelTime()
+{
+	if (JoinTravelStartSeconds <= 0.0)
+		return -1.f;
+
+	LastJoinSeconds = static_cast<float>(FPlatformTime::Seconds() - JoinTravelStartSeconds);
+	JoinTravelStartSeconds = 0.0;
+
+	if (NetBenchmarkRunner.IsValid())
+		NetBenchmarkRunner->OnJoinPlayable(LastJoinSeconds);
+
+	return LastJoinSeconds;
+}
+
+void USessionGameInstance::OnTravelFailure(UWorld* World, ETravelFailure::Type FailureType, const FString& ErrorString)
+{
+	// Otherwise the next possession, e.g. after hosting, reports the time since this join as time-to-playable
+	if (JoinTravelStartSeconds > 0.0)
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("Join travel failed: %s"), *ErrorString);
+		JoinTravelStartSeconds = 0.0;
+	}
+
+	PendingReplaySessionName = NAME_None;
+}
+
+void USessionGameInstance::OnNetworkFailure(UWorld* World, UNetDriver* NetDriver, ENetworkFailure::Type FailureType, const FString& ErrorString)
+{
+	if (JoinTravelStartSeconds > 0.0)
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("Join connection failed: %s"), *ErrorString);
+		JoinTravelStartSeconds = 0.0;
+	}
+}
+
 void USessionGameInstance::OnDestroySessionComplete(FName SessionName, bool bWasSuccessful)
 {
 	GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("OnDestroySessionComplete %s, %d"), *SessionName.ToString(), bWasSuccessful));
@@ -313,19 +397,76 @@ void USessionGameInstance::OnDestroySessionComplete(FName SessionName, bool bWas
 			// Clear the Delegate
 			Sessions->ClearOnDestroySessionCompleteDelegate_Handle(OnDestroySessionCompleteDelegateHandle);
 
-			// If it was successful, we just load another level (could be a MainMenu!)
-			if (bWasSuccessful)
+			// If it was successful, go back to the menu
+			if (bWasSuccessful && false == bShuttingDown)
 			{
-				UGameplayStatics::OpenLevel(GetWorld(), "ThirdPersonExampleMap", true);
+				if (NM_Client == GetWorld()->GetNetMode() || false == IsInFrontEndWorld())
+				{
+					UGameplayStatics::OpenLevel(GetWorld(), FName(FrontEndMapName), true);
+				}
 			}
 		}
 	}
 }
 
+void USessionGameInstance::Init()
+{
+	Super::Init();
+
+	if (SessionMemoryCsvInterval > 0.f)
+	{
+		MemoryCsvTickHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &USessionGameInstance::TickMemoryCsv), SessionMemoryCsvInterval);
+	}
+
+	PreLoadMapHandle = FCoreUObjectDelegates::PreLoadMap.AddUObject(this, &USessionGameInstance::OnPreLoadMap);
+	PostLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddUObject(this, &USessionGameInstance::OnPostLoadMapWithWorld);
+
+	if (GEngine)
+	{
+		TravelFailureHandle = GEngine->OnTravelFailure().AddUObject(this, &USessionGameInstance::OnTravelFailure);
+		NetworkFailureHandle = GEngine->OnNetworkFailure().AddUObject(this, &USessionGameInstance::OnNetworkFailure);
+	}
+
+	// Multi match server mode
+	int32 NumMatches = 0;
+	if (IsDedicatedServerInstance() && FParse::Value(FCommandLine::Get(), TEXT("MultiMatch="), NumMatches))
+	{
+		for (int32 Index = 1; Index <= NumMatches; ++Index)
+		{
+			StartMatch(FString::Printf(TEXT("Match%d"), Index));
+		}
+	}
+}
+
 void USessionGameInstance::Shutdown()
 {
+	bShuttingDown = true;
+
 	DestroySessionAndLeaveGame();
 
+	// The destroy callback may never arrive during shutdown, flush the replay here
+	ReplayBenchmarkPhases.Reset();
+	StopReplayRecording();
+
+	NetBenchmarkRunner.Reset();
+	MatchServer.Reset();
+
+	FCoreUObjectDelegates::PreLoadMap.Remove(PreLoadMapHandle);
+	FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapHandle);
+	PendingMapInstance = nullptr;
+
+	if (GEngine)
+	{
+		GEngine->OnTravelFailure().Remove(TravelFailureHandle);
+		GEngine->OnNetworkFailure().Remove(NetworkFailureHandle);
+	}
+
+	if (MemoryCsvTickHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(MemoryCsvTickHandle);
+		MemoryCsvTickHandle.Reset();
+	}
+
 	Super::Shutdown();
 }
 
@@ -351,7 +492,7 @@ void USessionGameInstance::StartOnlineGame(FName SessionName)
 	GameSessionName = SessionName;
 
 	// Call our custom HostSession function. GameSessionName is a GameInstance variable
-	HostSession(UniqueNetId, SessionName, true, true, 4);
+	HostSession(UniqueNetId, SessionName, true, true, 4, bRecordHostedSessions);
 }
 
 void USessionGameInstance::FindOnlineGames()
@@ -402,6 +543,9 @@ void USessionGameInstance::JoinOnlineGame(FBlueprintSessionResult SessionResult)
 		return;
 	}
 
+	// Needed to destroy the joined session when leaving
+	GameSessionName = FName(SessionName);
+
 	JoinSession(UniqueNetId, FName(SessionName), SessionResult.OnlineResult);
 }
 
@@ -414,13 +558,237 @@ void USessionGameInstance::DestroySessionAndLeaveGame()
 
 		if (Sessions.IsValid())
 		{
-			Sessions->AddOnDestroySessionCompleteDelegate_Handle(OnDestroySessionCompleteDelegate);
+			StopReplayRecording();
+
+			OnDestroySessionCompleteDelegateHandle = Sessions->AddOnDestroySessionCompleteDelegate_Handle(OnDestroySessionCompleteDelegate);
 
 			Sessions->DestroySession(GameSessionName);
 		}
 	}
 }
 
+void USessionGameInstance::NetBenchmark()
+{
+	if (NetBenchmarkRunner.IsValid() && NetBenchmarkRunner->IsRunning())
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("NetBenchmark: already running"));
+		return;
+	}
+
+	TArray<FSessionNetScenario> Scenarios = FSessionNetBenchmark::MakeScenarios(NetBenchmarkRttMs, NetBenchmarkLossPercent, bNetBenchmarkReorder);
+	if (Scenarios.Num() == 0)
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("NetBenchmark: NetBenchmarkRttMs and NetBenchmarkLossPercent must not be empty"));
+		return;
+	}
+
+	NetBenchmarkRunner = MakeShared<FSessionNetBenchmark>(this, Scenarios, NetBenchmarkJoinAttempts, NetBenchmarkMovementSeconds);
+	NetBenchmarkRunner->Start();
+}
+
+void USessionGameInstance::NetBenchmarkCancel()
+{
+	if (NetBenchmarkRunner.IsValid())
+	{
+		NetBenchmarkRunner->Cancel();
+		NetBenchmarkRunner.Reset();
+	}
+}
+
+void USessionGameInstance::SessionMemReport()
+{
+	TArray<FSessionMemoryEntry> Entries;
+	FSessionMemoryReport::Collect(this, Entries);
+	FSessionMemoryReport::Log(Entries, true);
+}
+
+bool USessionGameInstance::TickMemoryCsv(float DeltaTime)
+{
+	TArray<FSessionMemoryEntry> Entries;
+	FSessionMemoryReport::Collect(this, Entries);
+
+	// Alerts only, the full breakdown goes to the CSV
+	FSessionMemoryReport::Log(Entries, false);
+	FSessionMemoryReport::AppendCsv(FPaths::ProfilingDir() / TEXT("SessionMemory.csv"), Entries);
+
+	return true;
+}
+
+FSessionMatchServer& USessionGameInstance::GetMatchServer()
+{
+	if (false == MatchServer.IsValid())
+	{
+		MatchServer = MakeShared<FSessionMatchServer>(this);
+	}
+
+	return *MatchServer;
+}
+
+void USessionGameInstance::OnPreLoadMap(const FString& MapName)
+{
+	if (false == FSessionMatchServer::IsMapInstanceName(MapName))
+		return;
+
+	PendingMapInstance = FSessionMatchServer::LoadMapInstance(MapName);
+	if (nullptr == PendingMapInstance)
+	{
+		UE_LOG(LogSessionsInC, Error, TEXT("Can't load match map %s"), *MapName);
+	}
+}
+
+void USessionGameInstance::OnPostLoadMapWithWorld(UWorld* LoadedWorld)
+{
+	PendingMapInstance = nullptr;
+
+	if (false == PendingReplaySessionName.IsNone() && LoadedWorld && LoadedWorld == GetWorld())
+	{
+		const FName SessionName = PendingReplaySessionName;
+		StartReplayRecording(SessionName);
+	}
+}
+
+bool USessionGameInstance::CanHostMatches() const
+{
+	// LoadMap spawns play actors for the local players of the owning game instance, a client or listen host would move into the match
+	if (false == IsDedicatedServerInstance())
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("MultiMatch: only dedicated servers can host matches"));
+		return false;
+	}
+
+	return true;
+}
+
+void USessionGameInstance::StartMatch(const FString& SessionName)
+{
+	if (false == CanHostMatches())
+		return;
+
+	FSessionMatchServer& Server = GetMatchServer();
+	Server.StartMatch(FName(SessionName), MultiMatchMapName, Server.GetNextPort(MultiMatchBasePort), MultiMatchMaxPlayers);
+}
+
+void USessionGameInstance::StopMatch(const FString& SessionName)
+{
+	if (MatchServer.IsValid())
+	{
+		MatchServer->StopMatch(FName(SessionName));
+	}
+}
+
+void USessionGameInstance::MatchStatus()
+{
+	GetMatchServer().LogStatus();
+}
+
+void USessionGameInstance::MatchDensityBenchmark(int32 NumMatches, float MeasureSeconds)
+{
+	if (false == CanHostMatches())
+		return;
+
+	GetMatchServer().StartDensityBenchmark(NumMatches > 0 ? NumMatches : 4, MultiMatchMapName, MultiMatchBasePort, MultiMatchMaxPlayers, MeasureSeconds);
+}
+
+bool USessionGameInstance::IsInFrontEndWorld() const
+{
+	UWorld* World = GetWorld();
+	if (nullptr == World)
+		return false;
+
+	return UWorld::RemovePIEPrefix(World->GetMapName()) == FrontEndMapName;
+}
+
 void USessionGameInstance::OnFindSessionResult_Implementation(const TArray<FBlueprintSessionResult>& SessionResult)
 {
 }
+
+void USessionGameInstance::StartReplayRecording(FName SessionName)
+{
+	StopReplayRecording();
+
+	const FString Filename = FPaths::ProjectSavedDir() / TEXT("Replays")
+		/ FString::Printf(TEXT("%s_%s.sicreplay"), *SessionName.ToString(), *FDateTime::Now().ToString());
+
+	ReplayRecorder = MakeShared<FSessionReplayRecorder>(Filename, ReplayFramesPerChunk, ReplayMaxPendingBytes);
+	if (false == ReplayRecorder->StartRecording())
+	{
+		ReplayRecorder.Reset();
+		return;
+	}
+
+	if (false == ReplayTickHandle.IsValid())
+	{
+		ReplayTickHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &USessionGameInstance::TickReplay), 1.f / FMath::Max(1.f, ReplayFrameRate));
+	}
+}
+
+void USessionGameInstance::StopReplayRecording()
+{
+	PendingReplaySessionName = NAME_None;
+
+	if (ReplayRecorder.IsValid())
+	{
+		ReplayRecorder->StopRecording();
+		ReplayRecorder.Reset();
+	}
+
+	if (ReplayTickHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(ReplayTickHandle);
+		ReplayTickHandle.Reset();
+	}
+}
+
+void USessionGameInstance::ReplayBenchmark(float PhaseSeconds)
+{
+	if (ReplayRecorder.IsValid() || (ReplayBenchmarkPhases.IsValid() && ReplayBenchmarkPhases->IsRunning()))
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("ReplayBenchmark: a replay is already being recorded"));
+		return;
+	}
+
+	FMemory::Memzero(ReplayBenchmarkBusyMs);
+	const int32 NumPhases = UE_ARRAY_COUNT(ReplayBenchmarkBusyMs);
+
+	ReplayBenchmarkPhases = MakeShared<FSessionBenchmarkPhases>();
+	ReplayBenchmarkPhases->OnPhaseMeasured = [this, NumPhases](int32 Phase, const FSessionBenchmarkPhaseStats& Stats)
+	{
+		ReplayBenchmarkBusyMs[Phase] = Stats.GetBusyMs();
+
+		if (Phase + 1 < NumPhases)
+		{
+			if ((Phase + 1) % 2 == 1)
+			{
+				StartReplayRecording(FName("ReplayBenchmark"));
+			}
+			else
+			{
+				StopReplayRecording();
+			}
+			return;
+		}
+
+		StopReplayRecording();
+
+		const double OffMs = 0.5 * (ReplayBenchmarkBusyMs[0] + ReplayBenchmarkBusyMs[2]);
+		const double OnMs = 0.5 * (ReplayBenchmarkBusyMs[1] + ReplayBenchmarkBusyMs[3]);
+
+		UE_LOG(LogSessionsInC, Log, TEXT("ReplayBenchmark: off %.3f ms/frame, on %.3f ms/frame, overhead %.3f ms (%.1f%%)")
+			, OffMs, OnMs, OnMs - OffMs, OffMs > 0.0 ? 100.0 * (OnMs - OffMs) / OffMs : 0.0);
+	};
+
+	const float Seconds = PhaseSeconds > 0.f ? PhaseSeconds : 10.f;
+	ReplayBenchmarkPhases->Start(NumPhases, Seconds);
+
+	UE_LOG(LogSessionsInC, Log, TEXT("ReplayBenchmark: 4 phases of %.1f s (off, on, off, on)"), Seconds);
+}
+
+bool USessionGameInstance::TickReplay(float DeltaTime)
+{
+	if (ReplayRecorder.IsValid())
+	{
+		ReplayRecorder->RecordFrame(GetWorld());
+	}
+
+	return true;
+}
@@ -5,14 +5,21 @@
 #include "SessionsInC.h"
 #include "FindSessionsCallbackProxy.h"
 #include "Engine/GameInstance.h"
+#include "Containers/Ticker.h"
 #include "SessionGameInstance.generated.h"
 
+class FSessionReplayRecorder;
+class FSessionNetBenchmark;
+class FSessionMatchServer;
+class FSessionBenchmarkPhases;
+class UPackage;
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FDele_SessionResult, bool, IsFind, const TArray<FBlueprintSessionResult>&, SessionResult);
 
 /**
  * 
  */
-UCLASS()
+UCLASS(config=Game)
 class SESSIONSINC_API USessionGameInstance : public UGameInstance
 {
 	GENERATED_BODY()
@@ -31,8 +38,9 @@ public:
 	*	@Param		bIsLAN			Is this is LAN Game?
 	*	@Param		bIsPresence		"Is the Session to create a presence Session"
 	*	@Param		MaxNumPlayers	        Number of Maximum allowed players on this "Session" (Server)
+	*	@Param		bRecordReplay		Record a compressed replay of the match once the session has started
 	*/
-	bool HostSession(TSharedPtr<const FUniqueNetId> UserId, FName SessionName, bool bIsLAN, bool bIsPresence, int32 MaxNumPlayers);
+	bool HostSession(TSharedPtr<const FUniqueNetId> UserId, FName SessionName, bool bIsLAN, bool bIsPresence, int32 MaxNumPlayers, bool bRecordReplay = false);
 
 	/* Delegate called when session created */
 	FOnCreateSessionCompleteDelegate OnCreateSessionCompleteDelegate;
@@ -119,6 +127,23 @@ public:
 	*/
 	void OnJoinSessionComplete(FName SessionName, EOnJoinSessionCompleteResult::Type Result);
 
+	/** Seconds from the last ClientTravel into a session until the pawn was controllable */
+	UPROPERTY(BlueprintReadOnly, Category = "Network|Join")
+	float LastJoinSeconds = -1.f;
+
+	/**
+	*	Called once the joining client controls its pawn.
+	*	@return seconds since ClientTravel, or -1 if no join was in flight
+	*/
+	float ConsumeJoinTravelTime();
+
+	/** Drop the join in flight, its time would otherwise be reported at the next possession */
+	void OnTravelFailure(UWorld* World, ETravelFailure::Type FailureType, const FString& ErrorString);
+	void OnNetworkFailure(UWorld* World, UNetDriver* NetDriver, ENetworkFailure::Type FailureType, const FString& ErrorString);
+
+	FDelegateHandle TravelFailureHandle;
+	FDelegateHandle NetworkFailureHandle;
+
 	//----------------------------------[ Destroy Session ]------------------------------------//
 
 	/** Delegate for destroying a session */
@@ -135,7 +160,143 @@ public:
 	*/
 	virtual void OnDestroySessionComplete(FName SessionName, bool bWasSuccessful);
 
+	virtual void Init() override;
+
 	virtual void Shutdown() override;
+
+	//----------------------------------[ Front End World ]------------------------------------//
+
+	/** Map that holds the menu, opened after leaving a session */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|FrontEnd")
+	FString FrontEndMapName = TEXT("EntryMap");
+
+	bool IsInFrontEndWorld() const;
+
+	//----------------------------------[ Replay Recording ]------------------------------------//
+
+	/** Record sessions started with StartOnlineGame */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite, Category = "Network|Replay")
+	bool bRecordHostedSessions = false;
+
+	/** Frames compressed together per chunk. Every chunk is a seekable checkpoint */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Replay")
+	int32 ReplayFramesPerChunk = 120;
+
+	/** Upper bound in bytes of frames waiting for the writer thread, frames are dropped above it */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Replay")
+	int32 ReplayMaxPendingBytes = 4 * 1024 * 1024;
+
+	/** Frames recorded per second, so the replay size doesn't grow with the host frame rate */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Replay", meta = (ClampMin = "1.0"))
+	float ReplayFrameRate = 30.f;
+
+	UFUNCTION(BlueprintCallable, Category = "Network|Replay")
+	void StartReplayRecording(FName SessionName);
+
+	UFUNCTION(BlueprintCallable, Category = "Network|Replay")
+	void StopReplayRecording();
+
+	/**
+	*	Console: ReplayBenchmark <PhaseSeconds>
+	*	Alternates recording off/on and logs the average busy host frame time of each phase
+	*/
+	UFUNCTION(Exec)
+	void ReplayBenchmark(float PhaseSeconds);
+
+	//----------------------------------[ Network Benchmark ]------------------------------------//
+
+	/** Round trip times of the benchmark matrix */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Benchmark")
+	TArray<int32> NetBenchmarkRttMs;
+
+	/** Packet loss percentages of the benchmark matrix */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Benchmark")
+	TArray<int32> NetBenchmarkLossPercent;
+
+	/** Also reorder packets in impaired scenarios */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Benchmark")
+	bool bNetBenchmarkReorder = true;
+
+	/** Joins per scenario */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Benchmark")
+	int32 NetBenchmarkJoinAttempts = 3;
+
+	/** Scripted movement after every join */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Benchmark")
+	float NetBenchmarkMovementSeconds = 10.f;
+
+	/**
+	*	Console: NetBenchmark
+	*	Runs Find/Join/move/Leave against a LAN host on this machine under every RTT x loss scenario
+	*	and writes Saved/Benchmarks/NetImpairment_<date>.json
+	*/
+	UFUNCTION(Exec)
+	void NetBenchmark();
+
+	UFUNCTION(Exec)
+	void NetBenchmarkCancel();
+
+	//----------------------------------[ Memory Report ]------------------------------------//
+
+	/** Budgets in bytes, 0 disables the alert */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Memory")
+	int64 SessionMemoryBudgetBytes = 0;
+
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Memory")
+	int64 SearchMemoryBudgetBytes = 0;
+
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Memory")
+	int64 PlayerMemoryBudgetBytes = 0;
+
+	/** Seconds between rows appended to Saved/Profiling/SessionMemory.csv, 0 disables the export */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Memory")
+	float SessionMemoryCsvInterval = 0.f;
+
+	/** Size of the Blueprint copies of the last search results */
+	int64 LastSearchResultBytes = 0;
+
+	/**
+	*	Console: SessionMemReport
+	*	Logs the memory used per session, per search and per player and checks the budgets
+	*/
+	UFUNCTION(Exec)
+	void SessionMemReport();
+
+	//----------------------------------[ Multi Match Server ]------------------------------------//
+
+	/** Map every match of a multi match server loads */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|MultiMatch")
+	FString MultiMatchMapName = TEXT("ThirdPersonMap");
+
+	/** Port of the primary world, matches listen on the ports after it */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|MultiMatch")
+	int32 MultiMatchBasePort = 7777;
+
+	UPROPERTY(Config, EditAnywhere, Category = "Network|MultiMatch")
+	int32 MultiMatchMaxPlayers = 4;
+
+	/** Console: StartMatch <SessionName>. Hosts another match in this process, dedicated servers only */
+	UFUNCTION(Exec)
+	void StartMatch(const FString& SessionName);
+
+	/** Console: StopMatch <SessionName> */
+	UFUNCTION(Exec)
+	void StopMatch(const FString& SessionName);
+
+	/** Matches hosted by this process, nullptr until the first match command */
+	const FSessionMatchServer* FindMatchServer() const { return MatchServer.Get(); }
+
+	/** Console: MatchStatus. Logs players, tick cost and memory of every match */
+	UFUNCTION(Exec)
+	void MatchStatus();
+
+	/**
+	*	Console: MatchDensityBenchmark <NumMatches> <MeasureSeconds>
+	*	Compares matches per GB and per core of this process against one process per match, dedicated servers only
+	*/
+	UFUNCTION(Exec)
+	void MatchDensityBenchmark(int32 NumMatches, float MeasureSeconds);
+
 	//----------------------------------[ Blueprint Func ]------------------------------------//
 
 	UFUNCTION(BlueprintCallable, Category = "Network|Test")
@@ -160,4 +321,52 @@ public:
 
 	UPROPERTY(BlueprintAssignable, VisibleAnywhere, BlueprintCallable)
 	FDele_SessionResult Fuc_Dele_SessionResult;
+
+private:
+	bool TickReplay(float DeltaTime);
+
+	bool bShuttingDown = false;
+
+	/** Record replay for the session that is currently being created */
+	bool bPendingReplayRecording = false;
+
+	/** Session whose replay starts once OpenLevel has loaded the gameplay map */
+	FName PendingReplaySessionName;
+
+	/** FPlatformTime::Seconds() at ClientTravel, 0 when no join is in flight */
+	double JoinTravelStartSeconds = 0.0;
+
+	TSharedPtr<FSessionReplayRecorder> ReplayRecorder;
+	TSharedPtr<FSessionNetBenchmark> NetBenchmarkRunner;
+
+	/** Created on first use, dedicated servers started with -MultiMatch=<N> create it in Init */
+	FSessionMatchServer& GetMatchServer();
+
+	/** Matches are only hosted by dedicated servers, logs why not otherwise */
+	bool CanHostMatches() const;
+
+	TSharedPtr<FSessionMatchServer> MatchServer;
+
+	/**
+	*	A multi match server welcomes clients with its match's copy of the map, which doesn't exist on disk.
+	*	Loads the copy from the source map before LoadMap looks for it.
+	*/
+	void OnPreLoadMap(const FString& MapName);
+	void OnPostLoadMapWithWorld(UWorld* LoadedWorld);
+
+	FDelegateHandle PreLoadMapHandle;
+	FDelegateHandle PostLoadMapHandle;
+
+	/** Match map copy held until LoadMap has picked it up, LoadMap collects garbage before loading */
+	UPROPERTY(Transient)
+	TObjectPtr<UPackage> PendingMapInstance;
+
+	bool TickMemoryCsv(float DeltaTime);
+
+	FTSTicker::FDelegateHandle MemoryCsvTickHandle;
+	FTSTicker::FDelegateHandle ReplayTickHandle;
+
+	/** ReplayBenchmark phases. Even phases record nothing, odd phases record */
+	TSharedPtr<FSessionBenchmarkPhases> ReplayBenchmarkPhases;
+	double ReplayBenchmarkBusyMs[4] = {};
 };
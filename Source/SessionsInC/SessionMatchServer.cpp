@@ -0,0 +1,433 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SessionMatchServer.h"
+#include "SessionsInC.h"
+#include "SessionGameInstance.h"
+#include "SessionsInCGameMode.h"
+#include "OnlineSessionSettings.h"
+#include "Online/OnlineSessionNames.h"
+#include "Misc/PackageName.h"
+#include "UObject/LinkerInstancingContext.h"
+#include "UObject/StrongObjectPtr.h"
+
+namespace SessionMatchServer
+{
+	/** Let a newly started match finish loading before measuring */
+	static const float SettleSeconds = 5.f;
+
+	/** Separates the source map from the match in an instanced package name */
+	static const TCHAR* InstanceInfix = TEXT("_MatchInstance_");
+}
+
+FSessionMatchServer::FSessionMatchServer(USessionGameInstance* InGameInstance)
+	: GameInstance(InGameInstance)
+{
+	TickStartHandle = FWorldDelegates::OnWorldTickStart.AddRaw(this, &FSessionMatchServer::OnWorldTickStart);
+	TickEndHandle = FWorldDelegates::OnWorldTickEnd.AddRaw(this, &FSessionMatchServer::OnWorldTickEnd);
+
+	IOnlineSubsystem* OnlineSub = IOnlineSubsystem::Get();
+	IOnlineSessionPtr Sessions = OnlineSub ? OnlineSub->GetSessionInterface() : nullptr;
+	if (Sessions.IsValid())
+	{
+		CreateSessionHandle = Sessions->AddOnCreateSessionCompleteDelegate_Handle(FOnCreateSessionCompleteDelegate::CreateRaw(this, &FSessionMatchServer::OnCreateSessionComplete));
+	}
+}
+
+FSessionMatchServer::~FSessionMatchServer()
+{
+	BenchmarkPhases.Stop();
+
+	StopAllMatches();
+
+	FWorldDelegates::OnWorldTickStart.Remove(TickStartHandle);
+	FWorldDelegates::OnWorldTickEnd.Remove(TickEndHandle);
+
+	IOnlineSubsystem* OnlineSub = IOnlineSubsystem::Get();
+	IOnlineSessionPtr Sessions = OnlineSub ? OnlineSub->GetSessionInterface() : nullptr;
+	if (Sessions.IsValid())
+	{
+		Sessions->ClearOnCreateSessionCompleteDelegate_Handle(CreateSessionHandle);
+	}
+}
+
+bool FSessionMatchServer::StartMatch(FName SessionName, const FString& MapName, int32 Port, int32 MaxPlayers)
+{
+	USessionGameInstance* GI = GameInstance.Get();
+	if (nullptr == GI || nullptr == GEngine)
+		return false;
+
+	if (Matches.ContainsByPredicate([SessionName](const FMatch& Match) { return Match.SessionName == SessionName; }))
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("MultiMatch: %s is already running"), *SessionName.ToString());
+		return false;
+	}
+
+	FString SourcePackageName = MapName;
+	if (false == FPackageName::IsValidLongPackageName(SourcePackageName)
+		&& false == FPackageName::SearchForPackageOnDisk(MapName + FPackageName::GetMapPackageExtension(), &SourcePackageName))
+	{
+		UE_LOG(LogSessionsInC, Error, TEXT("MultiMatch: can't find map %s for %s"), *MapName, *SessionName.ToString());
+		return false;
+	}
+
+	// Every match loads its own copy of the map under an instanced package name, like level instances do.
+	// LoadMap finds an already loaded package by name, so loading the plain map twice would hand every match the same world
+	const FString InstancedPackageName = FString::Printf(TEXT("%s%s%s_%d"), *SourcePackageName, SessionMatchServer::InstanceInfix, *SessionName.ToString(), ++NumMapInstances);
+	if (false == FPackageName::IsValidLongPackageName(InstancedPackageName))
+	{
+		UE_LOG(LogSessionsInC, Error, TEXT("MultiMatch: %s is not a valid package name"), *InstancedPackageName);
+		return false;
+	}
+
+	// Held until LoadMap picks the package up, LoadMap collects garbage before loading
+	TStrongObjectPtr<UPackage> MapInstance(LoadMapInstance(InstancedPackageName));
+	if (false == MapInstance.IsValid())
+	{
+		UE_LOG(LogSessionsInC, Error, TEXT("MultiMatch: can't load %s as %s"), *SourcePackageName, *InstancedPackageName);
+		return false;
+	}
+
+	// A world context of its own, so the match gets an isolated world and net driver
+	FWorldContext& Context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	Context.OwningGameInstance = GI;
+
+	// The map's World Settings pick a Blueprint game mode without the late join and governor code
+	FURL URL(nullptr, *FString::Printf(TEXT("%s?listen?%s"), *InstancedPackageName, *ASessionsInCGameMode::GetGameURLOption()), TRAVEL_Absolute);
+	URL.Port = Port;
+
+	// LoadMap makes the new world GWorld, the primary world has to stay current for the rest of the frame
+	UWorld* PreviousGWorld = GWorld;
+
+	FString Error;
+	const bool bLoaded = GEngine->LoadMap(Context, URL, nullptr, Error);
+
+	GWorld = PreviousGWorld;
+
+	UWorld* World = Context.World();
+	if (false == bLoaded || nullptr == World)
+	{
+		UE_LOG(LogSessionsInC, Error, TEXT("MultiMatch: can't load %s for %s: %s"), *InstancedPackageName, *SessionName.ToString(), *Error);
+
+		if (World)
+		{
+			GEngine->DestroyWorldContext(World);
+			World->DestroyWorld(true);
+		}
+		else
+		{
+			GEngine->DestroyWorldContext(nullptr);
+		}
+		return false;
+	}
+
+	// Two matches sharing a world would tick, replicate and count players twice
+	const bool bSharedWorld = World == GI->GetWorld() || nullptr != FindMatch(World);
+	if (false == ensureMsgf(false == bSharedWorld, TEXT("MultiMatch: %s got the world of another match"), *SessionName.ToString()))
+	{
+		UE_LOG(LogSessionsInC, Error, TEXT("MultiMatch: %s got world %s of another match"), *SessionName.ToString(), *World->GetPathName());
+
+		// The world belongs to another context, only drop the new context
+		Context.SetCurrentWorld(nullptr);
+		GEngine->DestroyWorldContext(nullptr);
+		return false;
+	}
+
+	FMatch& Match = Matches.AddDefaulted_GetRef();
+	Match.SessionName = SessionName;
+	Match.Port = Port;
+	Match.World = World;
+
+	AdvertiseMatch(Match, MapName, MaxPlayers);
+
+	UE_LOG(LogSessionsInC, Log, TEXT("MultiMatch: %s running %s on port %d (%d matches)"), *SessionName.ToString(), *InstancedPackageName, Port, Matches.Num());
+	return true;
+}
+
+void FSessionMatchServer::StopMatch(FName SessionName)
+{
+	const int32 Index = Matches.IndexOfByPredicate([SessionName](const FMatch& Match) { return Match.SessionName == SessionName; });
+	if (INDEX_NONE == Index)
+		return;
+
+	IOnlineSubsystem* OnlineSub = IOnlineSubsystem::Get();
+	IOnlineSessionPtr Sessions = OnlineSub ? OnlineSub->GetSessionInterface() : nullptr;
+	if (Sessions.IsValid())
+	{
+		Sessions->DestroySession(SessionName);
+	}
+
+	if (UWorld* World = Matches[Index].World.Get())
+	{
+		GEngine->ShutdownWorldNetDriver(World);
+		GEngine->DestroyWorldContext(World);
+		World->DestroyWorld(true);
+	}
+
+	Matches.RemoveAt(Index);
+
+	UE_LOG(LogSessionsInC, Log, TEXT("MultiMatch: %s stopped (%d matches)"), *SessionName.ToString(), Matches.Num());
+}
+
+void FSessionMatchServer::StopAllMatches()
+{
+	while (Matches.Num() > 0)
+	{
+		StopMatch(Matches.Last().SessionName);
+	}
+}
+
+int32 FSessionMatchServer::GetNextPort(int32 BasePort) const
+{
+	// BasePort itself belongs to the primary world
+	int32 Port = BasePort + 1;
+	for (const FMatch& Match : Matches)
+	{
+		Port = FMath::Max(Port, Match.Port + 1);
+	}
+
+	return Port;
+}
+
+bool FSessionMatchServer::IsMapInstanceName(const FString& PackageName)
+{
+	return PackageName.Contains(SessionMatchServer::InstanceInfix, ESearchCase::CaseSensitive);
+}
+
+UPackage* FSessionMatchServer::LoadMapInstance(const FString& InstancedPackageName)
+{
+	if (UPackage* Package = FindPackage(nullptr, *InstancedPackageName))
+		return Package;
+
+	const int32 InfixIndex = InstancedPackageName.Find(SessionMatchServer::InstanceInfix, ESearchCase::CaseSensitive, ESearchDir::FromEnd);
+	if (INDEX_NONE == InfixIndex)
+		return nullptr;
+
+	const FString SourcePackageName = InstancedPackageName.Left(InfixIndex);
+
+	FPackagePath SourcePackagePath;
+	if (false == FPackagePath::TryFromPackageName(SourcePackageName, SourcePackagePath))
+		return nullptr;
+
+	// References from the map to itself have to resolve inside the copy
+	FLinkerInstancingContext InstancingContext;
+	InstancingContext.AddPackageMapping(FName(*SourcePackageName), FName(*InstancedPackageName));
+
+	const int32 RequestId = LoadPackageAsync(SourcePackagePath, FName(*InstancedPackageName), FLoadPackageAsyncDelegate(), PKG_ContainsMap, INDEX_NONE, 0, &InstancingContext);
+	FlushAsyncLoading(RequestId);
+
+	return FindPackage(nullptr, *InstancedPackageName);
+}
+
+void FSessionMatchServer::AdvertiseMatch(const FMatch& Match, const FString& MapName, int32 MaxPlayers)
+{
+	IOnlineSubsystem* OnlineSub = IOnlineSubsystem::Get();
+	IOnlineSessionPtr Sessions = OnlineSub ? OnlineSub->GetSessionInterface() : nullptr;
+	if (false == Sessions.IsValid())
+		return;
+
+	FOnlineSessionSettings Settings;
+	Settings.bIsDedicated = true;
+	Settings.bIsLANMatch = true;
+	Settings.bUsesPresence = false;
+	Settings.NumPublicConnections = MaxPlayers;
+	Settings.NumPrivateConnections = 0;
+	Settings.bAllowJoinInProgress = true;
+	Settings.bShouldAdvertise = true;
+
+	Settings.Set(FName("SESSION_NAME"), Match.SessionName.ToString(), EOnlineDataAdvertisementType::ViaOnlineServiceAndPing);
+	Settings.Set(SETTING_MAPNAME, MapName, EOnlineDataAdvertisementType::ViaOnlineService);
+
+	// Every match listens on its own port, clients read it back in OnJoinSessionComplete
+	Settings.Set(FName("SESSION_PORT"), Match.Port, EOnlineDataAdvertisementType::ViaOnlineServiceAndPing);
+
+	Sessions->CreateSession(0, Match.SessionName, Settings);
+}
+
+void FSessionMatchServer::OnCreateSessionComplete(FName SessionName, bool bWasSuccessful)
+{
+	if (false == Matches.ContainsByPredicate([SessionName](const FMatch& Match) { return Match.SessionName == SessionName; }))
+		return;
+
+	UE_LOG(LogSessionsInC, Log, TEXT("MultiMatch: session %s created %d"), *SessionName.ToString(), bWasSuccessful);
+
+	IOnlineSubsystem* OnlineSub = IOnlineSubsystem::Get();
+	IOnlineSessionPtr Sessions = OnlineSub ? OnlineSub->GetSessionInterface() : nullptr;
+	if (bWasSuccessful && Sessions.IsValid())
+	{
+		Sessions->StartSession(SessionName);
+	}
+}
+
+FSessionMatchServer::FMatch* FSessionMatchServer::FindMatch(const UWorld* World)
+{
+	return Matches.FindByPredicate([World](const FMatch& Match) { return Match.World.Get() == World; });
+}
+
+void FSessionMatchServer::OnWorldTickStart(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (FMatch* Match = FindMatch(World))
+	{
+		Match->TickStartCycles = FPlatformTime::Cycles();
+	}
+}
+
+void FSessionMatchServer::OnWorldTickEnd(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (FMatch* Match = FindMatch(World))
+	{
+		if (Match->TickStartCycles != 0)
+		{
+			Match->TickCycles += FPlatformTime::Cycles() - Match->TickStartCycles;
+			++Match->TickFrames;
+			Match->TickStartCycles = 0;
+		}
+	}
+}
+
+void FSessionMatchServer::LogStatus() const
+{
+	const FPlatformMemoryStats MemoryStats = FPlatformMemory::GetStats();
+
+	UE_LOG(LogSessionsInC, Log, TEXT("MultiMatch: %d matches, process %.1f MB"), Matches.Num(), MemoryStats.UsedPhysical / (1024.0 * 1024.0));
+
+	for (const FMatch& Match : Matches)
+	{
+		const UWorld* World = Match.World.Get();
+		UE_LOG(LogSessionsInC, Log, TEXT("MultiMatch:   %-16s port %d, players %d, tick %.3f ms")
+			, *Match.SessionName.ToString(), Match.Port
+			, World ? World->GetNumPlayerControllers() : 0
+			, Match.TickFrames > 0 ? FPlatformTime::ToMilliseconds64(Match.TickCycles) / Match.TickFrames : 0.0);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Density Benchmark
+
+void FSessionMatchServer::StartDensityBenchmark(int32 NumMatches, const FString& MapName, int32 BasePort, int32 MaxPlayers, float MeasureSeconds)
+{
+	if (BenchmarkPhases.IsRunning())
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("MatchDensity: already running"));
+		return;
+	}
+
+	// The baseline is the process without any match, never stop matches players are in
+	if (Matches.Num() > 0)
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("MatchDensity: %d matches are running, stop them first"), Matches.Num());
+		return;
+	}
+
+	BenchmarkNumMatches = FMath::Max(2, NumMatches);
+	BenchmarkMapName = MapName;
+	BenchmarkBasePort = BasePort;
+	BenchmarkMaxPlayers = MaxPlayers;
+
+	BenchmarkPhases.OnPhaseMeasureStart = [this](int32 Phase) { ResetMatchTickCounters(); };
+	BenchmarkPhases.OnPhaseMeasured = [this](int32 Phase, const FSessionBenchmarkPhaseStats& Stats) { OnBenchmarkPhaseMeasured(Phase, Stats); };
+
+	const float PhaseSeconds = MeasureSeconds > 0.f ? MeasureSeconds : 10.f;
+	BenchmarkPhases.Start(UE_ARRAY_COUNT(BenchmarkSamples), PhaseSeconds, SessionMatchServer::SettleSeconds);
+
+	UE_LOG(LogSessionsInC, Log, TEXT("MatchDensity: measuring 0, 1 and %d matches of %s, %.0f s each"), BenchmarkNumMatches, *MapName, PhaseSeconds);
+}
+
+void FSessionMatchServer::ResetMatchTickCounters()
+{
+	for (FMatch& Match : Matches)
+	{
+		Match.TickCycles = 0;
+		Match.TickFrames = 0;
+	}
+}
+
+void FSessionMatchServer::OnBenchmarkPhaseMeasured(int32 Phase, const FSessionBenchmarkPhaseStats& Stats)
+{
+	FBenchmarkSample& Sample = BenchmarkSamples[Phase];
+	Sample.NumMatches = Matches.Num();
+	Sample.UsedPhysicalMB = FPlatformMemory::GetStats().UsedPhysical / (1024.0 * 1024.0);
+	Sample.FrameMs = Stats.GetBusyMs();
+	Sample.CoreUtilization = Stats.GetCoreUtilization();
+
+	uint64 MatchCycles = 0;
+	for (const FMatch& Match : Matches)
+	{
+		MatchCycles += Match.TickCycles;
+	}
+	Sample.MatchTickMs = Stats.Frames > 0 ? FPlatformTime::ToMilliseconds64(MatchCycles) / Stats.Frames : 0.0;
+
+	switch (Phase)
+	{
+	case 0:
+		StartMatch(FName("Density1"), BenchmarkMapName, GetNextPort(BenchmarkBasePort), BenchmarkMaxPlayers);
+		break;
+
+	case 1:
+		for (int32 Index = 2; Index <= BenchmarkNumMatches; ++Index)
+		{
+			StartMatch(FName(*FString::Printf(TEXT("Density%d"), Index)), BenchmarkMapName, GetNextPort(BenchmarkBasePort), BenchmarkMaxPlayers);
+		}
+		break;
+
+	default:
+		WriteBenchmarkReport();
+		StopAllMatches();
+		break;
+	}
+}
+
+void FSessionMatchServer::WriteBenchmarkReport()
+{
+	const FBenchmarkSample& Idle = BenchmarkSamples[0];
+	const FBenchmarkSample& One = BenchmarkSamples[1];
+	const FBenchmarkSample& All = BenchmarkSamples[2];
+	const int32 NumMatches = FMath::Max(1, All.NumMatches);
+
+	// One process per match pays the idle engine for every match
+	const double ProcessPerMatchMB = One.UsedPhysicalMB;
+	const double MultiMatchMB = All.UsedPhysicalMB / NumMatches;
+
+	const double ProcessPerMatchCore = One.CoreUtilization;
+	const double MultiMatchCore = All.CoreUtilization / NumMatches;
+
+	const double ProcessPerMatchPerGB = ProcessPerMatchMB > 0.0 ? 1024.0 / ProcessPerMatchMB : 0.0;
+	const double MultiMatchPerGB = MultiMatchMB > 0.0 ? 1024.0 / MultiMatchMB : 0.0;
+	const double ProcessPerMatchPerCore = ProcessPerMatchCore > 0.0 ? 1.0 / ProcessPerMatchCore : 0.0;
+	const double MultiMatchPerCore = MultiMatchCore > 0.0 ? 1.0 / MultiMatchCore : 0.0;
+
+	FSessionBenchmarkReport Report(TEXT("MatchDensity"));
+	FSessionBenchmarkReport::FWriter& Writer = Report.GetWriter();
+
+	Writer.WriteValue(TEXT("Map"), BenchmarkMapName);
+
+	Writer.WriteArrayStart(TEXT("Samples"));
+	for (const FBenchmarkSample& Sample : BenchmarkSamples)
+	{
+		Writer.WriteObjectStart();
+		Writer.WriteValue(TEXT("NumMatches"), Sample.NumMatches);
+		Writer.WriteValue(TEXT("UsedPhysicalMB"), Sample.UsedPhysicalMB);
+		Writer.WriteValue(TEXT("FrameMs"), Sample.FrameMs);
+		Writer.WriteValue(TEXT("MatchTickMs"), Sample.MatchTickMs);
+		Writer.WriteValue(TEXT("CoreUtilization"), Sample.CoreUtilization);
+		Writer.WriteObjectEnd();
+	}
+	Writer.WriteArrayEnd();
+
+	Writer.WriteObjectStart(TEXT("ProcessPerMatch"));
+	Writer.WriteValue(TEXT("MatchesPerGB"), ProcessPerMatchPerGB);
+	Writer.WriteValue(TEXT("MatchesPerCore"), ProcessPerMatchPerCore);
+	Writer.WriteObjectEnd();
+
+	Writer.WriteObjectStart(TEXT("MultiMatch"));
+	Writer.WriteValue(TEXT("MatchesPerGB"), MultiMatchPerGB);
+	Writer.WriteValue(TEXT("MatchesPerCore"), MultiMatchPerCore);
+	Writer.WriteObjectEnd();
+
+	UE_LOG(LogSessionsInC, Log, TEXT("MatchDensity: idle %.1f MB, 1 match %.1f MB, %d matches %.1f MB")
+		, Idle.UsedPhysicalMB, One.UsedPhysicalMB, All.NumMatches, All.UsedPhysicalMB);
+	UE_LOG(LogSessionsInC, Log, TEXT("MatchDensity: process per match %.2f matches/GB %.2f matches/core, multi match %.2f matches/GB %.2f matches/core")
+		, ProcessPerMatchPerGB, ProcessPerMatchPerCore, MultiMatchPerGB, MultiMatchPerCore);
+
+	Report.Save();
+}
@@ -0,0 +1,118 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "SessionBenchmark.h"
+
+class USessionGameInstance;
+class UPackage;
+class UWorld;
+
+/**
+*	Hosts several matches inside one dedicated server process.
+*
+*	Every match gets its own world context with its own copy of the map, loaded under an instanced package name
+*	the way level instances are, its own net driver listening on a separate port and its own advertised session.
+*	The engine ticks all world contexts one after another on the game thread, once per engine frame,
+*	so matches share the frame rate of the process. The game thread cost of each match is measured separately.
+*
+*	Run it from the SessionsInCServer target, which needs a source built engine: SessionsInCServer -MultiMatch=<N> -log.
+*	Without it, the editor binary works as a dedicated server too: UnrealEditor SessionsInC.uproject -server -MultiMatch=<N> -log.
+*/
+class FSessionMatchServer
+{
+public:
+	struct FMatch
+	{
+		FName SessionName;
+		int32 Port = 0;
+		TWeakObjectPtr<UWorld> World;
+
+		/** Game thread cost of this match's world tick, including the net driver's replication */
+		uint32 TickStartCycles = 0;
+		uint64 TickCycles = 0;
+		int32 TickFrames = 0;
+	};
+
+	FSessionMatchServer(USessionGameInstance* InGameInstance);
+	~FSessionMatchServer();
+
+	/** Loads a copy of MapName into a new world listening on Port and advertises it as SessionName */
+	bool StartMatch(FName SessionName, const FString& MapName, int32 Port, int32 MaxPlayers);
+
+	void StopMatch(FName SessionName);
+	void StopAllMatches();
+
+	int32 GetNumMatches() const { return Matches.Num(); }
+	const TArray<FMatch>& GetMatches() const { return Matches; }
+
+	/** Port for the next match, after the ports of the running ones */
+	int32 GetNextPort(int32 BasePort) const;
+
+	/** Logs players, tick cost and memory of every match */
+	void LogStatus() const;
+
+	/**
+	*	Compares matches per GB and per core of this process against one process per match.
+	*	Measures the idle process, then one match, then NumMatches, and writes Saved/Benchmarks/MatchDensity_<date>.json.
+	*	Refuses to run while matches are being hosted.
+	*/
+	void StartDensityBenchmark(int32 NumMatches, const FString& MapName, int32 BasePort, int32 MaxPlayers, float MeasureSeconds);
+
+	//----------------------------------[ Map Instances ]------------------------------------//
+
+	/** True if PackageName names a match's copy of a map */
+	static bool IsMapInstanceName(const FString& PackageName);
+
+	/**
+	*	Loads the copy of a map named by an instanced package name, or returns it if it's already loaded.
+	*	Clients call this before loading the map the server welcomed them with, which is the instanced name.
+	*/
+	static UPackage* LoadMapInstance(const FString& InstancedPackageName);
+
+private:
+	FMatch* FindMatch(const UWorld* World);
+
+	void OnWorldTickStart(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+	void OnWorldTickEnd(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	void AdvertiseMatch(const FMatch& Match, const FString& MapName, int32 MaxPlayers);
+	void OnCreateSessionComplete(FName SessionName, bool bWasSuccessful);
+
+	//----------------------------------[ Density Benchmark ]------------------------------------//
+
+	struct FBenchmarkSample
+	{
+		int32 NumMatches = 0;
+		double UsedPhysicalMB = 0.0;
+		double FrameMs = 0.0;
+		double MatchTickMs = 0.0;
+
+		/** Busy game thread time per second of wall time */
+		double CoreUtilization = 0.0;
+	};
+
+	void OnBenchmarkPhaseMeasured(int32 Phase, const FSessionBenchmarkPhaseStats& Stats);
+	void ResetMatchTickCounters();
+	void WriteBenchmarkReport();
+
+	TWeakObjectPtr<USessionGameInstance> GameInstance;
+	TArray<FMatch> Matches;
+
+	/** Makes every instanced package name unique, a stopped match's package may not be collected yet */
+	int32 NumMapInstances = 0;
+
+	FDelegateHandle TickStartHandle;
+	FDelegateHandle TickEndHandle;
+	FDelegateHandle CreateSessionHandle;
+
+	/** Idle process, one match, all matches */
+	FSessionBenchmarkPhases BenchmarkPhases;
+	FBenchmarkSample BenchmarkSamples[3];
+	int32 BenchmarkNumMatches = 0;
+	FString BenchmarkMapName;
+	int32 BenchmarkBasePort = 0;
+	int32 BenchmarkMaxPlayers = 0;
+};
@@ -0,0 +1,207 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SessionMemoryReport.h"
+#include "SessionsInC.h"
+#include "SessionGameInstance.h"
+#include "SessionMatchServer.h"
+#include "SessionsInCCharacter.h"
+#include "OnlineSessionSettings.h"
+#include "EngineUtils.h"
+#include "GameFramework/PlayerState.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/ArchiveCountMem.h"
+
+namespace SessionMemory
+{
+	static int64 GetSettingsBytes(const FOnlineSessionSettings& Settings)
+	{
+		int64 Bytes = Settings.Settings.GetAllocatedSize() + Settings.MemberSettings.GetAllocatedSize();
+
+		for (const TPair<FName, FOnlineSessionSetting>& Setting : Settings.Settings)
+		{
+			// Only string values own heap memory
+			if (Setting.Value.Data.GetType() == EOnlineKeyValuePairDataType::String)
+			{
+				FString Value;
+				Setting.Value.Data.GetValue(Value);
+				Bytes += Value.GetAllocatedSize();
+			}
+		}
+
+		return Bytes;
+	}
+
+	static int64 GetSearchResultBytes(const FOnlineSessionSearchResult& Result)
+	{
+		return sizeof(FOnlineSessionSearchResult) + Result.Session.OwningUserName.GetAllocatedSize() + GetSettingsBytes(Result.Session.SessionSettings);
+	}
+
+	static void AddSession(IOnlineSession& Sessions, FName SessionName, int64 BudgetBytes, TArray<FSessionMemoryEntry>& OutEntries)
+	{
+		if (const FNamedOnlineSession* NamedSession = Sessions.GetNamedSession(SessionName))
+		{
+			FSessionMemoryEntry& Entry = OutEntries.AddDefaulted_GetRef();
+			Entry.Category = TEXT("Session");
+			Entry.Name = SessionName.ToString();
+			Entry.Bytes = sizeof(FNamedOnlineSession)
+				+ NamedSession->RegisteredPlayers.GetAllocatedSize()
+				+ GetSettingsBytes(NamedSession->SessionSettings);
+			Entry.BudgetBytes = BudgetBytes;
+		}
+	}
+
+	/** The characters of World with all their components, NamePrefix tells the worlds of a multi match server apart */
+	static void AddPlayers(UWorld* World, const FString& NamePrefix, int64 BudgetBytes, TArray<FSessionMemoryEntry>& OutEntries)
+	{
+		for (TActorIterator<ASessionsInCCharacter> It(World); It; ++It)
+		{
+			ASessionsInCCharacter* Character = *It;
+
+			FSessionMemoryEntry& Entry = OutEntries.AddDefaulted_GetRef();
+			Entry.Category = TEXT("Player");
+			Entry.Name = NamePrefix + (Character->GetPlayerState() ? Character->GetPlayerState()->GetPlayerName() : Character->GetName());
+			Entry.Bytes = FSessionMemoryReport::GetObjectBytes(Character);
+
+			for (UActorComponent* Component : Character->GetComponents())
+			{
+				Entry.Bytes += FSessionMemoryReport::GetObjectBytes(Component);
+			}
+			Entry.BudgetBytes = BudgetBytes;
+		}
+	}
+}
+
+int64 FSessionMemoryReport::GetObjectBytes(const UObject* Object)
+{
+	if (nullptr == Object)
+		return 0;
+
+	FArchiveCountMem CountMem(const_cast<UObject*>(Object));
+	return CountMem.GetMax();
+}
+
+void FSessionMemoryReport::Collect(const USessionGameInstance* GameInstance, TArray<FSessionMemoryEntry>& OutEntries)
+{
+	if (nullptr == GameInstance)
+		return;
+
+	// Sessions
+	IOnlineSubsystem* OnlineSub = IOnlineSubsystem::Get();
+	IOnlineSessionPtr Sessions = OnlineSub ? OnlineSub->GetSessionInterface() : nullptr;
+
+	if (Sessions.IsValid() && false == GameInstance->GameSessionName.IsNone())
+	{
+		SessionMemory::AddSession(*Sessions, GameInstance->GameSessionName, GameInstance->SessionMemoryBudgetBytes, OutEntries);
+	}
+
+	// Every match of a multi match server has its own session and world
+	const FSessionMatchServer* MatchServer = GameInstance->FindMatchServer();
+	if (MatchServer && Sessions.IsValid())
+	{
+		for (const FSessionMatchServer::FMatch& Match : MatchServer->GetMatches())
+		{
+			SessionMemory::AddSession(*Sessions, Match.SessionName, GameInstance->SessionMemoryBudgetBytes, OutEntries);
+		}
+	}
+
+	if (GameInstance->SessionSettings.IsValid())
+	{
+		FSessionMemoryEntry& Entry = OutEntries.AddDefaulted_GetRef();
+		Entry.Category = TEXT("Session");
+		Entry.Name = TEXT("HostSettings");
+		Entry.Bytes = sizeof(FOnlineSessionSettings) + SessionMemory::GetSettingsBytes(*GameInstance->SessionSettings);
+		Entry.BudgetBytes = GameInstance->SessionMemoryBudgetBytes;
+	}
+
+	// Searches
+	if (GameInstance->SessionSearch.IsValid())
+	{
+		FSessionMemoryEntry& Entry = OutEntries.AddDefaulted_GetRef();
+		Entry.Category = TEXT("Search");
+		Entry.Name = FString::Printf(TEXT("SessionSearch (%d results)"), GameInstance->SessionSearch->SearchResults.Num());
+		Entry.Bytes = sizeof(FOnlineSessionSearch) + GameInstance->SessionSearch->QuerySettings.SearchParams.GetAllocatedSize();
+
+		for (const FOnlineSessionSearchResult& Result : GameInstance->SessionSearch->SearchResults)
+		{
+			Entry.Bytes += SessionMemory::GetSearchResultBytes(Result);
+		}
+		Entry.BudgetBytes = GameInstance->SearchMemoryBudgetBytes;
+	}
+
+	if (GameInstance->LastSearchResultBytes > 0)
+	{
+		FSessionMemoryEntry& Entry = OutEntries.AddDefaulted_GetRef();
+		Entry.Category = TEXT("Search");
+		Entry.Name = TEXT("BlueprintResults");
+		Entry.Bytes = GameInstance->LastSearchResultBytes;
+		Entry.BudgetBytes = GameInstance->SearchMemoryBudgetBytes;
+	}
+
+	// Players, the character with all its components
+	if (UWorld* World = GameInstance->GetWorld())
+	{
+		SessionMemory::AddPlayers(World, FString(), GameInstance->PlayerMemoryBudgetBytes, OutEntries);
+	}
+
+	if (MatchServer)
+	{
+		for (const FSessionMatchServer::FMatch& Match : MatchServer->GetMatches())
+		{
+			if (UWorld* World = Match.World.Get())
+			{
+				SessionMemory::AddPlayers(World, Match.SessionName.ToString() + TEXT("/"), GameInstance->PlayerMemoryBudgetBytes, OutEntries);
+			}
+		}
+	}
+}
+
+int32 FSessionMemoryReport::Log(const TArray<FSessionMemoryEntry>& Entries, bool bVerbose)
+{
+	int32 NumOverBudget = 0;
+	int64 TotalBytes = 0;
+
+	for (const FSessionMemoryEntry& Entry : Entries)
+	{
+		TotalBytes += Entry.Bytes;
+
+		if (Entry.IsOverBudget())
+		{
+			++NumOverBudget;
+
+			const FString Message = FString::Printf(TEXT("SessionMemory: %s %s uses %.1f KB, budget %.1f KB")
+				, *Entry.Category, *Entry.Name, Entry.Bytes / 1024.0, Entry.BudgetBytes / 1024.0);
+
+			UE_LOG(LogSessionsInC, Warning, TEXT("%s"), *Message);
+			GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, Message);
+		}
+		else if (bVerbose)
+		{
+			UE_LOG(LogSessionsInC, Log, TEXT("SessionMemory: %-8s %-32s %10.1f KB"), *Entry.Category, *Entry.Name, Entry.Bytes / 1024.0);
+		}
+	}
+
+	if (bVerbose)
+	{
+		UE_LOG(LogSessionsInC, Log, TEXT("SessionMemory: %d entries, %.1f KB total, %d over budget"), Entries.Num(), TotalBytes / 1024.0, NumOverBudget);
+	}
+
+	return NumOverBudget;
+}
+
+bool FSessionMemoryReport::AppendCsv(const FString& Filename, const TArray<FSessionMemoryEntry>& Entries)
+{
+	FString Csv;
+	if (false == IFileManager::Get().FileExists(*Filename))
+	{
+		Csv += TEXT("Timestamp,Category,Name,Bytes,BudgetBytes\n");
+	}
+
+	const FString Timestamp = FDateTime::UtcNow().ToIso8601();
+	for (const FSessionMemoryEntry& Entry : Entries)
+	{
+		Csv += FString::Printf(TEXT("%s,%s,\"%s\",%lld,%lld\n"), *Timestamp, *Entry.Category, *Entry.Name.Replace(TEXT("\""), TEXT("\"\"")), Entry.Bytes, Entry.BudgetBytes);
+	}
+
+	return FFileHelper::SaveStringToFile(Csv, *Filename, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+}
@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class USessionGameInstance;
+
+/** Memory used by one session, search or player */
+struct FSessionMemoryEntry
+{
+	/** "Session", "Search" or "Player" */
+	FString Category;
+	FString Name;
+	int64 Bytes = 0;
+
+	/** 0 when there is no budget */
+	int64 BudgetBytes = 0;
+
+	bool IsOverBudget() const { return BudgetBytes > 0 && Bytes > BudgetBytes; }
+};
+
+/**
+*	Breaks down the memory of the session layer per session, per search and per player.
+*	The numbers are the sizes of the objects and their containers, the LLM tags
+*	SessionsInC_Session / SessionsInC_Character give the allocator's view of the same memory.
+*/
+class FSessionMemoryReport
+{
+public:
+	static void Collect(const USessionGameInstance* GameInstance, TArray<FSessionMemoryEntry>& OutEntries);
+
+	/** Logs every entry and warns about the ones over budget. Returns the number of entries over budget */
+	static int32 Log(const TArray<FSessionMemoryEntry>& Entries, bool bVerbose);
+
+	/** Appends the entries to a CSV file, writing the header if the file is new */
+	static bool AppendCsv(const FString& Filename, const TArray<FSessionMemoryEntry>& Entries);
+
+	/** Size of a UObject including what it owns in containers */
+	static int64 GetObjectBytes(const UObject* Object);
+};
@@ -0,0 +1,378 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SessionNetBenchmark.h"
+#include "SessionsInC.h"
+#include "SessionBenchmark.h"
+#include "SessionGameInstance.h"
+#include "SessionsInCCharacterMovement.h"
+#include "OnlineSessionSettings.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/NetConnection.h"
+
+namespace SessionNetBenchmark
+{
+	static const float FindTimeoutSeconds = 15.f;
+	static const float JoinTimeoutSeconds = 30.f;
+	static const float LeaveTimeoutSeconds = 20.f;
+
+	/** Give the front end a moment to settle before the next attempt */
+	static const float LeaveSettleSeconds = 1.f;
+
+	static const float MoveYawPerSecond = 90.f;
+	static const float JumpIntervalSeconds = 2.f;
+}
+
+FSessionNetBenchmark::FSessionNetBenchmark(USessionGameInstance* InGameInstance, const TArray<FSessionNetScenario>& InScenarios, int32 InJoinAttempts, float InMovementSeconds)
+	: GameInstance(InGameInstance)
+	, Scenarios(InScenarios)
+	, JoinAttempts(FMath::Max(1, InJoinAttempts))
+	, MovementSeconds(FMath::Max(1.f, InMovementSeconds))
+{
+}
+
+FSessionNetBenchmark::~FSessionNetBenchmark()
+{
+	Cancel();
+}
+
+TArray<FSessionNetScenario> FSessionNetBenchmark::MakeScenarios(const TArray<int32>& RttMs, const TArray<int32>& LossPercent, bool bReorder)
+{
+	TArray<FSessionNetScenario> OutScenarios;
+
+	for (int32 Rtt : RttMs)
+	{
+		for (int32 Loss : LossPercent)
+		{
+			FSessionNetScenario& Scenario = OutScenarios.AddDefaulted_GetRef();
+			Scenario.RttMs = Rtt;
+			Scenario.LossPercent = Loss;
+			Scenario.bReorder = bReorder && (Rtt > 0 || Loss > 0);
+			Scenario.Name = FString::Printf(TEXT("rtt%d_loss%d%s"), Rtt, Loss, Scenario.bReorder ? TEXT("_reorder") : TEXT(""));
+		}
+	}
+
+	return OutScenarios;
+}
+
+void FSessionNetBenchmark::Start()
+{
+	if (IsRunning() || Scenarios.Num() == 0)
+		return;
+
+	Results.Reset();
+	Results.SetNum(Scenarios.Num());
+	ScenarioIndex = 0;
+	AttemptIndex = 0;
+
+	UE_LOG(LogSessionsInC, Log, TEXT("NetBenchmark: %d scenarios x %d joins, %.0f s movement each"), Scenarios.Num(), JoinAttempts, MovementSeconds);
+
+	TickHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FSessionNetBenchmark::Tick));
+
+	BeginScenario();
+	BeginAttempt();
+}
+
+void FSessionNetBenchmark::Cancel()
+{
+	if (false == IsRunning())
+		return;
+
+	FTSTicker::GetCoreTicker().RemoveTicker(TickHandle);
+	TickHandle.Reset();
+	Step = EStep::Idle;
+
+	ClearEmulation();
+
+	UE_LOG(LogSessionsInC, Log, TEXT("NetBenchmark: cancelled"));
+}
+
+bool FSessionNetBenchmark::Tick(float DeltaTime)
+{
+	USessionGameInstance* GI = GameInstance.Get();
+	if (nullptr == GI)
+	{
+		TickHandle.Reset();
+		return false;
+	}
+
+	StepSeconds += DeltaTime;
+
+	switch (Step)
+	{
+	case EStep::Finding:
+		if (StepSeconds > SessionNetBenchmark::FindTimeoutSeconds)
+		{
+			EndAttempt(false);
+		}
+		break;
+
+	case EStep::Joining:
+	{
+		// Playable once the local player controls a pawn in the server's world.
+		// Doesn't depend on the map running ASessionsInCGameMode, which spawns the controller that reports it otherwise.
+		UWorld* World = GI->GetWorld();
+		APlayerController* PlayerController = GI->GetFirstLocalPlayerController(World);
+		if (World && NM_Client == World->GetNetMode() && PlayerController && PlayerController->GetPawn())
+		{
+			// Calls OnJoinPlayable
+			GI->ConsumeJoinTravelTime();
+		}
+
+		if (Step == EStep::Joining && StepSeconds > SessionNetBenchmark::JoinTimeoutSeconds)
+		{
+			EndAttempt(false);
+		}
+		break;
+	}
+
+	case EStep::Moving:
+		TickMovement(DeltaTime);
+		break;
+
+	case EStep::Leaving:
+	{
+		UWorld* World = GI->GetWorld();
+		const bool bBackInMenu = World && NM_Standalone == World->GetNetMode() && GI->IsInFrontEndWorld();
+
+		if ((bBackInMenu && StepSeconds > SessionNetBenchmark::LeaveSettleSeconds) || StepSeconds > SessionNetBenchmark::LeaveTimeoutSeconds)
+		{
+			if (++AttemptIndex >= JoinAttempts)
+			{
+				AttemptIndex = 0;
+
+				if (++ScenarioIndex >= Scenarios.Num())
+				{
+					Step = EStep::Idle;
+					TickHandle.Reset();
+
+					ClearEmulation();
+					WriteReport();
+					return false;
+				}
+
+				BeginScenario();
+			}
+
+			BeginAttempt();
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	return true;
+}
+
+void FSessionNetBenchmark::BeginScenario()
+{
+	const FSessionNetScenario& Scenario = Scenarios[ScenarioIndex];
+
+	UE_LOG(LogSessionsInC, Log, TEXT("NetBenchmark: scenario %d/%d %s"), ScenarioIndex + 1, Scenarios.Num(), *Scenario.Name);
+
+	ApplyEmulation(Scenario);
+}
+
+void FSessionNetBenchmark::BeginAttempt()
+{
+	Step = EStep::Finding;
+	StepSeconds = 0.f;
+
+	++Results[ScenarioIndex].Attempts;
+
+	if (USessionGameInstance* GI = GameInstance.Get())
+	{
+		GI->FindOnlineGames();
+	}
+}
+
+void FSessionNetBenchmark::EndAttempt(bool bJoined)
+{
+	if (false == bJoined)
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("NetBenchmark: %s attempt %d failed while %s")
+			, *Scenarios[ScenarioIndex].Name, AttemptIndex + 1, Step == EStep::Finding ? TEXT("finding") : TEXT("joining"));
+	}
+
+	Step = EStep::Leaving;
+	StepSeconds = 0.f;
+
+	// Also needed after a failed join, the local session still exists
+	if (USessionGameInstance* GI = GameInstance.Get())
+	{
+		GI->DestroySessionAndLeaveGame();
+	}
+}
+
+void FSessionNetBenchmark::OnFindSessionsComplete(bool bWasSuccessful)
+{
+	if (Step != EStep::Finding)
+		return;
+
+	USessionGameInstance* GI = GameInstance.Get();
+	if (nullptr == GI || false == bWasSuccessful || false == GI->SessionSearch.IsValid() || GI->SessionSearch->SearchResults.Num() == 0)
+	{
+		EndAttempt(false);
+		return;
+	}
+
+	Step = EStep::Joining;
+	StepSeconds = 0.f;
+
+	FBlueprintSessionResult SessionResult;
+	SessionResult.OnlineResult = GI->SessionSearch->SearchResults[0];
+
+	GI->JoinOnlineGame(SessionResult);
+}
+
+void FSessionNetBenchmark::OnJoinPlayable(float Seconds)
+{
+	if (Step != EStep::Joining)
+		return;
+
+	FScenarioResult& Result = Results[ScenarioIndex];
+	++Result.Joins;
+	Result.JoinSeconds.Add(Seconds);
+
+	Step = EStep::Moving;
+	StepSeconds = 0.f;
+	MoveYaw = 0.f;
+	NextJumpSeconds = SessionNetBenchmark::JumpIntervalSeconds;
+	CorrectionsAtStart = INDEX_NONE;
+}
+
+void FSessionNetBenchmark::TickMovement(float DeltaTime)
+{
+	USessionGameInstance* GI = GameInstance.Get();
+	APlayerController* PlayerController = GI ? GI->GetFirstLocalPlayerController() : nullptr;
+	ACharacter* Character = PlayerController ? Cast<ACharacter>(PlayerController->GetPawn()) : nullptr;
+	USessionsInCCharacterMovement* Movement = Character ? Cast<USessionsInCCharacterMovement>(Character->GetCharacterMovement()) : nullptr;
+
+	FScenarioResult& Result = Results[ScenarioIndex];
+
+	if (Character)
+	{
+		// Run in circles and jump now and then, that's where corrections show up
+		MoveYaw = FMath::Fmod(MoveYaw + SessionNetBenchmark::MoveYawPerSecond * DeltaTime, 360.f);
+		Character->AddMovementInput(FRotator(0.f, MoveYaw, 0.f).Vector(), 1.f);
+
+		if (StepSeconds >= NextJumpSeconds)
+		{
+			Character->Jump();
+			NextJumpSeconds += SessionNetBenchmark::JumpIntervalSeconds;
+		}
+	}
+
+	if (Movement && INDEX_NONE == CorrectionsAtStart)
+	{
+		CorrectionsAtStart = Movement->GetNumClientCorrections();
+	}
+
+	if (UNetConnection* Connection = PlayerController ? PlayerController->GetNetConnection() : nullptr)
+	{
+		Result.InBytesPerSecond += Connection->InBytesPerSecond;
+		Result.OutBytesPerSecond += Connection->OutBytesPerSecond;
+		++Result.BandwidthSamples;
+	}
+
+	if (StepSeconds >= MovementSeconds)
+	{
+		if (Movement && CorrectionsAtStart != INDEX_NONE)
+		{
+			Result.Corrections += Movement->GetNumClientCorrections() - CorrectionsAtStart;
+		}
+		Result.MovementSeconds += StepSeconds;
+
+		EndAttempt(true);
+	}
+}
+
+void FSessionNetBenchmark::ApplyEmulation(const FSessionNetScenario& Scenario)
+{
+#if DO_ENABLE_NET_TEST
+	USessionGameInstance* GI = GameInstance.Get();
+	if (nullptr == GI)
+		return;
+
+	// Half of the RTT on each direction, so only the client needs to be impaired
+	const int32 HalfRtt = Scenario.RttMs / 2;
+
+	const FString Commands[] =
+	{
+		FString::Printf(TEXT("NetEmulation.PktLag %d"), HalfRtt),
+		FString::Printf(TEXT("NetEmulation.PktIncomingLagMin %d"), HalfRtt),
+		FString::Printf(TEXT("NetEmulation.PktIncomingLagMax %d"), HalfRtt),
+		FString::Printf(TEXT("NetEmulation.PktLoss %d"), Scenario.LossPercent),
+		FString::Printf(TEXT("NetEmulation.PktIncomingLoss %d"), Scenario.LossPercent),
+		FString::Printf(TEXT("NetEmulation.PktOrder %d"), Scenario.bReorder ? 1 : 0),
+	};
+
+	for (const FString& Command : Commands)
+	{
+		GEngine->Exec(GI->GetWorld(), *Command);
+	}
+#else
+	UE_LOG(LogSessionsInC, Warning, TEXT("NetBenchmark: network emulation is compiled out, %s runs unimpaired"), *Scenario.Name);
+#endif
+}
+
+void FSessionNetBenchmark::ClearEmulation()
+{
+	FSessionNetScenario NoImpairment;
+	ApplyEmulation(NoImpairment);
+}
+
+void FSessionNetBenchmark::WriteReport()
+{
+	FSessionBenchmarkReport Report(TEXT("NetImpairment"));
+	FSessionBenchmarkReport::FWriter& Writer = Report.GetWriter();
+
+	Writer.WriteValue(TEXT("JoinAttempts"), JoinAttempts);
+	Writer.WriteValue(TEXT("MovementSeconds"), MovementSeconds);
+
+	Writer.WriteArrayStart(TEXT("Scenarios"));
+	for (int32 Index = 0; Index < Scenarios.Num(); ++Index)
+	{
+		const FSessionNetScenario& Scenario = Scenarios[Index];
+		const FScenarioResult& Result = Results[Index];
+
+		float JoinMean = 0.f;
+		float JoinMax = 0.f;
+		for (float Seconds : Result.JoinSeconds)
+		{
+			JoinMean += Seconds;
+			JoinMax = FMath::Max(JoinMax, Seconds);
+		}
+		JoinMean = Result.JoinSeconds.Num() > 0 ? JoinMean / Result.JoinSeconds.Num() : 0.f;
+
+		const float SuccessRate = Result.Attempts > 0 ? static_cast<float>(Result.Joins) / Result.Attempts : 0.f;
+		const float CorrectionsPerMinute = Result.MovementSeconds > 0.f ? Result.Corrections * 60.f / Result.MovementSeconds : 0.f;
+		const double InRate = Result.BandwidthSamples > 0 ? Result.InBytesPerSecond / Result.BandwidthSamples : 0.0;
+		const double OutRate = Result.BandwidthSamples > 0 ? Result.OutBytesPerSecond / Result.BandwidthSamples : 0.0;
+
+		Writer.WriteObjectStart();
+		Writer.WriteValue(TEXT("Name"), Scenario.Name);
+		Writer.WriteValue(TEXT("RttMs"), Scenario.RttMs);
+		Writer.WriteValue(TEXT("LossPercent"), Scenario.LossPercent);
+		Writer.WriteValue(TEXT("Reorder"), Scenario.bReorder);
+		Writer.WriteValue(TEXT("Attempts"), Result.Attempts);
+		Writer.WriteValue(TEXT("Joins"), Result.Joins);
+		Writer.WriteValue(TEXT("JoinSuccessRate"), SuccessRate);
+		Writer.WriteValue(TEXT("JoinSecondsMean"), JoinMean);
+		Writer.WriteValue(TEXT("JoinSecondsMax"), JoinMax);
+		Writer.WriteValue(TEXT("Corrections"), Result.Corrections);
+		Writer.WriteValue(TEXT("CorrectionsPerMinute"), CorrectionsPerMinute);
+		Writer.WriteValue(TEXT("InBytesPerSecond"), InRate);
+		Writer.WriteValue(TEXT("OutBytesPerSecond"), OutRate);
+		Writer.WriteObjectEnd();
+
+		UE_LOG(LogSessionsInC, Log, TEXT("NetBenchmark: %-24s joins %d/%d, join %.2f s (max %.2f), corrections %.1f/min, in %.0f B/s, out %.0f B/s")
+			, *Scenario.Name, Result.Joins, Result.Attempts, JoinMean, JoinMax, CorrectionsPerMinute, InRate, OutRate);
+	}
+	Writer.WriteArrayEnd();
+
+	Report.Save();
+}
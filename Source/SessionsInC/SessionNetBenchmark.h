@@ -0,0 +1,95 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+
+class USessionGameInstance;
+
+/** One set of emulated network conditions */
+struct FSessionNetScenario
+{
+	FString Name;
+	int32 RttMs = 0;
+	int32 LossPercent = 0;
+	bool bReorder = false;
+};
+
+/**
+*	Runs the client side of the session flow (Find -> Join -> ClientTravel -> scripted movement -> Leave)
+*	under a matrix of emulated network conditions and writes the results as JSON to Saved/Benchmarks.
+*
+*	The host is a separate process on the same machine that hosts a LAN session with StartOnlineGame.
+*	Network emulation needs a build with DO_ENABLE_NET_TEST (not Shipping).
+*/
+class FSessionNetBenchmark
+{
+public:
+	FSessionNetBenchmark(USessionGameInstance* InGameInstance, const TArray<FSessionNetScenario>& InScenarios, int32 InJoinAttempts, float InMovementSeconds);
+	~FSessionNetBenchmark();
+
+	void Start();
+	void Cancel();
+	bool IsRunning() const { return TickHandle.IsValid(); }
+
+	/** Hooks called by the game instance. The benchmark also polls for the joined pawn, so joins count whatever controller the map spawns */
+	void OnFindSessionsComplete(bool bWasSuccessful);
+	void OnJoinPlayable(float Seconds);
+
+	/** Builds the RTT x loss matrix */
+	static TArray<FSessionNetScenario> MakeScenarios(const TArray<int32>& RttMs, const TArray<int32>& LossPercent, bool bReorder);
+
+private:
+	enum class EStep : uint8
+	{
+		Idle,
+		Finding,
+		Joining,
+		Moving,
+		Leaving,
+	};
+
+	struct FScenarioResult
+	{
+		int32 Attempts = 0;
+		int32 Joins = 0;
+		TArray<float> JoinSeconds;
+		int32 Corrections = 0;
+		float MovementSeconds = 0.f;
+		double InBytesPerSecond = 0.0;
+		double OutBytesPerSecond = 0.0;
+		int32 BandwidthSamples = 0;
+	};
+
+	bool Tick(float DeltaTime);
+
+	void BeginScenario();
+	void BeginAttempt();
+	void EndAttempt(bool bJoined);
+	void TickMovement(float DeltaTime);
+
+	void ApplyEmulation(const FSessionNetScenario& Scenario);
+	void ClearEmulation();
+	void WriteReport();
+
+	TWeakObjectPtr<USessionGameInstance> GameInstance;
+	TArray<FSessionNetScenario> Scenarios;
+	TArray<FScenarioResult> Results;
+
+	int32 JoinAttempts;
+	float MovementSeconds;
+
+	int32 ScenarioIndex = 0;
+	int32 AttemptIndex = 0;
+
+	EStep Step = EStep::Idle;
+	float StepSeconds = 0.f;
+
+	/** Scripted movement state */
+	int32 CorrectionsAtStart = 0;
+	float MoveYaw = 0.f;
+	float NextJumpSeconds = 0.f;
+
+	FTSTicker::FDelegateHandle TickHandle;
+};
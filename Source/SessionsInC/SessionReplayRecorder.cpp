@@ -0,0 +1,345 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SessionReplayRecorder.h"
+#include "SessionsInC.h"
+#include "EngineUtils.h"
+#include "GameFramework/Character.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+#include "Algo/BinarySearch.h"
+
+namespace SessionReplay
+{
+	static const uint32 StreamMagic = 0x52434953; // "SICR"
+	static const uint32 IndexMagic = 0x49434953; // "SICI"
+	static const uint32 ChunkMagic = 0x4B434953; // "SICK"
+	static const uint32 Version = 2;
+
+	/** Magic, FrameIndex, TimeSeconds, CompressedSize, UncompressedSize */
+	static const int32 ChunkHeaderSize = sizeof(uint32) * 2 + sizeof(double) + sizeof(int32) * 2;
+}
+
+FSessionReplayRecorder::FSessionReplayRecorder(const FString& InFilename, int32 InFramesPerChunk, int32 InMaxPendingBytes)
+	: Filename(InFilename)
+	, FramesPerChunk(FMath::Max(1, InFramesPerChunk))
+	, MaxPendingBytes(FMath::Max(1024, InMaxPendingBytes))
+{
+}
+
+FSessionReplayRecorder::~FSessionReplayRecorder()
+{
+	StopRecording();
+}
+
+bool FSessionReplayRecorder::StartRecording()
+{
+	if (Thread)
+		return true;
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.CreateDirectoryTree(*FPaths::GetPath(Filename));
+
+	FileHandle.Reset(PlatformFile.OpenWrite(*Filename));
+	if (false == FileHandle.IsValid())
+	{
+		UE_LOG(LogSessionsInC, Error, TEXT("Replay: can't open %s for writing"), *Filename);
+		return false;
+	}
+
+	uint32 Magic = SessionReplay::StreamMagic;
+	uint32 Version = SessionReplay::Version;
+	FileHandle->Write(reinterpret_cast<const uint8*>(&Magic), sizeof(Magic));
+	FileHandle->Write(reinterpret_cast<const uint8*>(&Version), sizeof(Version));
+
+	bStopRequested = false;
+	WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	Thread = FRunnableThread::Create(this, TEXT("SessionReplayWriter"), 0, TPri_BelowNormal);
+	if (nullptr == Thread)
+	{
+		UE_LOG(LogSessionsInC, Error, TEXT("Replay: can't create the writer thread for %s"), *Filename);
+
+		FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+		WorkEvent = nullptr;
+		FileHandle.Reset();
+		return false;
+	}
+
+	UE_LOG(LogSessionsInC, Log, TEXT("Replay: recording to %s"), *Filename);
+	return true;
+}
+
+void FSessionReplayRecorder::StopRecording()
+{
+	if (nullptr == Thread)
+		return;
+
+	// Run() drains the queue and writes the index before returning
+	Stop();
+	Thread->WaitForCompletion();
+	delete Thread;
+	Thread = nullptr;
+
+	FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+	WorkEvent = nullptr;
+	FileHandle.Reset();
+
+	UE_LOG(LogSessionsInC, Log, TEXT("Replay: stopped %s (%d frames, %d dropped, %d checkpoints, %.3f ms/frame)")
+		, *Filename, GetRecordedFrames(), DroppedFrames, Checkpoints.Num(), GetAverageRecordMs());
+}
+
+void FSessionReplayRecorder::RecordFrame(UWorld* World)
+{
+	if (nullptr == Thread || nullptr == World)
+		return;
+
+	const uint32 StartCycles = FPlatformTime::Cycles();
+
+	FPendingFrame Frame;
+	Frame.FrameIndex = FrameIndex;
+	Frame.TimeSeconds = World->GetTimeSeconds();
+	Frame.Data.Reserve(LastFrameSize);
+
+	FMemoryWriter Writer(Frame.Data);
+	Writer << Frame.FrameIndex << Frame.TimeSeconds;
+
+	// Character count is patched in after iterating
+	const int64 CountOffset = Writer.Tell();
+	int32 NumCharacters = 0;
+	Writer << NumCharacters;
+
+	for (TActorIterator<ACharacter> It(World); It; ++It)
+	{
+		ACharacter* Character = *It;
+
+		uint32 Id = Character->GetUniqueID();
+		FVector3f Location(Character->GetActorLocation());
+		FRotator3f Rotation(Character->GetActorRotation());
+		FVector3f Velocity(Character->GetVelocity());
+		FRotator3f ControlRotation(Character->GetControlRotation());
+
+		Writer << Id << Location << Rotation << Velocity << ControlRotation;
+		++NumCharacters;
+	}
+
+	const int64 EndOffset = Writer.Tell();
+	Writer.Seek(CountOffset);
+	Writer << NumCharacters;
+	Writer.Seek(EndOffset);
+
+	++FrameIndex;
+	LastFrameSize = Frame.Data.Num();
+
+	// Never stall the host on I/O. If the writer can't keep up, drop the frame.
+	if (PendingBytes.GetValue() + LastFrameSize > MaxPendingBytes)
+	{
+		++DroppedFrames;
+	}
+	else
+	{
+		PendingBytes.Add(LastFrameSize);
+		PendingFrames.Enqueue(MoveTemp(Frame));
+		WorkEvent->Trigger();
+	}
+
+	RecordCycles += FPlatformTime::Cycles() - StartCycles;
+}
+
+double FSessionReplayRecorder::GetAverageRecordMs() const
+{
+	return FrameIndex > 0 ? FPlatformTime::ToMilliseconds64(RecordCycles) / FrameIndex : 0.0;
+}
+
+uint32 FSessionReplayRecorder::Run()
+{
+	while (false == bStopRequested)
+	{
+		WorkEvent->Wait(100);
+		DrainQueue();
+	}
+
+	DrainQueue();
+	FlushChunk();
+	WriteIndex();
+
+	return 0;
+}
+
+void FSessionReplayRecorder::Stop()
+{
+	bStopRequested = true;
+
+	if (WorkEvent)
+		WorkEvent->Trigger();
+}
+
+void FSessionReplayRecorder::DrainQueue()
+{
+	FPendingFrame Frame;
+	while (PendingFrames.Dequeue(Frame))
+	{
+		if (0 == FramesInChunk)
+		{
+			CurrentCheckpoint.FrameIndex = Frame.FrameIndex;
+			CurrentCheckpoint.TimeSeconds = Frame.TimeSeconds;
+		}
+
+		FMemoryWriter Writer(ChunkBuffer, false, true);
+		int32 Size = Frame.Data.Num();
+		Writer << Size;
+		Writer.Serialize(Frame.Data.GetData(), Size);
+
+		PendingBytes.Subtract(Size);
+
+		if (++FramesInChunk >= FramesPerChunk)
+		{
+			FlushChunk();
+		}
+	}
+}
+
+void FSessionReplayRecorder::FlushChunk()
+{
+	if (0 == FramesInChunk || false == FileHandle.IsValid())
+		return;
+
+	const int32 UncompressedSize = ChunkBuffer.Num();
+	int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, UncompressedSize);
+	CompressedBuffer.SetNumUninitialized(CompressedSize, EAllowShrinking::No);
+
+	if (false == FCompression::CompressMemory(NAME_Zlib, CompressedBuffer.GetData(), CompressedSize, ChunkBuffer.GetData(), UncompressedSize))
+	{
+		UE_LOG(LogSessionsInC, Warning, TEXT("Replay: failed to compress chunk at frame %u, dropping %d frames"), CurrentCheckpoint.FrameIndex, FramesInChunk);
+	}
+	else
+	{
+		CurrentCheckpoint.CompressedSize = CompressedSize;
+		CurrentCheckpoint.UncompressedSize = UncompressedSize;
+
+		// Every chunk carries its own header, so the stream can be re-indexed when the host dies before WriteIndex
+		ChunkHeader.Reset();
+		FMemoryWriter HeaderWriter(ChunkHeader);
+		uint32 Magic = SessionReplay::ChunkMagic;
+		HeaderWriter << Magic << CurrentCheckpoint.FrameIndex << CurrentCheckpoint.TimeSeconds << CurrentCheckpoint.CompressedSize << CurrentCheckpoint.UncompressedSize;
+		FileHandle->Write(ChunkHeader.GetData(), ChunkHeader.Num());
+
+		CurrentCheckpoint.FileOffset = FileHandle->Tell();
+		FileHandle->Write(CompressedBuffer.GetData(), CompressedSize);
+		FileHandle->Flush();
+
+		Checkpoints.Add(CurrentCheckpoint);
+	}
+
+	ChunkBuffer.Reset();
+	FramesInChunk = 0;
+}
+
+void FSessionReplayRecorder::WriteIndex()
+{
+	if (FileHandle.IsValid())
+	{
+		FileHandle->Flush();
+	}
+
+	TArray<uint8> IndexData;
+	FMemoryWriter Writer(IndexData);
+
+	uint32 Magic = SessionReplay::IndexMagic;
+	uint32 Version = SessionReplay::Version;
+	Writer << Magic << Version << Checkpoints;
+
+	FFileHelper::SaveArrayToFile(IndexData, *GetIndexFilename(Filename));
+}
+
+FString FSessionReplayRecorder::GetIndexFilename(const FString& ReplayFilename)
+{
+	return FPaths::ChangeExtension(ReplayFilename, TEXT("idx"));
+}
+
+bool FSessionReplayRecorder::LoadCheckpoints(const FString& ReplayFilename, TArray<FSessionReplayCheckpoint>& OutCheckpoints)
+{
+	TArray<uint8> IndexData;
+	if (FFileHelper::LoadFileToArray(IndexData, *GetIndexFilename(ReplayFilename)))
+	{
+		FMemoryReader Reader(IndexData);
+
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		Reader << Magic << Version;
+		if (Magic == SessionReplay::IndexMagic && Version == SessionReplay::Version)
+		{
+			Reader << OutCheckpoints;
+			if (false == Reader.IsError())
+				return true;
+		}
+	}
+
+	// No usable index, the recording most likely never reached StopRecording
+	return RebuildCheckpoints(ReplayFilename, OutCheckpoints);
+}
+
+bool FSessionReplayRecorder::RebuildCheckpoints(const FString& ReplayFilename, TArray<FSessionReplayCheckpoint>& OutCheckpoints)
+{
+	OutCheckpoints.Reset();
+
+	TUniquePtr<IFileHandle> ReadHandle(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*ReplayFilename));
+	if (false == ReadHandle.IsValid())
+		return false;
+
+	uint32 StreamHeader[2] = { 0, 0 };
+	if (false == ReadHandle->Read(reinterpret_cast<uint8*>(StreamHeader), sizeof(StreamHeader))
+		|| StreamHeader[0] != SessionReplay::StreamMagic || StreamHeader[1] != SessionReplay::Version)
+		return false;
+
+	const int64 FileSize = ReadHandle->Size();
+	TArray<uint8> Header;
+	Header.SetNumUninitialized(SessionReplay::ChunkHeaderSize);
+
+	// Walk the chunk headers, a chunk cut off by the crash ends the scan
+	while (ReadHandle->Tell() + SessionReplay::ChunkHeaderSize <= FileSize)
+	{
+		if (false == ReadHandle->Read(Header.GetData(), Header.Num()))
+			break;
+
+		FMemoryReader Reader(Header);
+		uint32 Magic = 0;
+		FSessionReplayCheckpoint Checkpoint;
+		Reader << Magic << Checkpoint.FrameIndex << Checkpoint.TimeSeconds << Checkpoint.CompressedSize << Checkpoint.UncompressedSize;
+
+		Checkpoint.FileOffset = ReadHandle->Tell();
+		if (Magic != SessionReplay::ChunkMagic || Checkpoint.CompressedSize <= 0 || Checkpoint.FileOffset + Checkpoint.CompressedSize > FileSize)
+			break;
+
+		OutCheckpoints.Add(Checkpoint);
+		ReadHandle->Seek(Checkpoint.FileOffset + Checkpoint.CompressedSize);
+	}
+
+	UE_LOG(LogSessionsInC, Log, TEXT("Replay: rebuilt %d checkpoints from %s"), OutCheckpoints.Num(), *ReplayFilename);
+	return OutCheckpoints.Num() > 0;
+}
+
+int32 FSessionReplayRecorder::FindCheckpoint(const TArray<FSessionReplayCheckpoint>& Checkpoints, double TimeSeconds)
+{
+	// Last checkpoint that starts at or before TimeSeconds
+	const int32 Upper = Algo::UpperBoundBy(Checkpoints, TimeSeconds, &FSessionReplayCheckpoint::TimeSeconds);
+	return Upper > 0 ? Upper - 1 : INDEX_NONE;
+}
+
+bool FSessionReplayRecorder::ReadChunk(const FString& ReplayFilename, const FSessionReplayCheckpoint& Checkpoint, TArray<uint8>& OutFrames)
+{
+	TUniquePtr<IFileHandle> ReadHandle(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*ReplayFilename));
+	if (false == ReadHandle.IsValid() || false == ReadHandle->Seek(Checkpoint.FileOffset))
+		return false;
+
+	TArray<uint8> Compressed;
+	Compressed.SetNumUninitialized(Checkpoint.CompressedSize);
+	if (false == ReadHandle->Read(Compressed.GetData(), Checkpoint.CompressedSize))
+		return false;
+
+	OutFrames.SetNumUninitialized(Checkpoint.UncompressedSize);
+	return FCompression::UncompressMemory(NAME_Zlib, OutFrames.GetData(), Checkpoint.UncompressedSize, Compressed.GetData(), Checkpoint.CompressedSize);
+}
@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "HAL/ThreadSafeBool.h"
+#include "Containers/Queue.h"
+
+class FRunnableThread;
+class FEvent;
+class IFileHandle;
+class UWorld;
+
+/**
+*	Index entry pointing at the start of a compressed chunk in the replay stream.
+*	Every chunk starts with a full snapshot, so any checkpoint can be decoded on its own.
+*	In the stream each chunk is preceded by a header holding the same fields, FileOffset points past it.
+*/
+struct FSessionReplayCheckpoint
+{
+	uint32 FrameIndex = 0;
+	double TimeSeconds = 0.0;
+	int64 FileOffset = 0;
+	int32 CompressedSize = 0;
+	int32 UncompressedSize = 0;
+
+	friend FArchive& operator<<(FArchive& Ar, FSessionReplayCheckpoint& Checkpoint)
+	{
+		return Ar << Checkpoint.FrameIndex << Checkpoint.TimeSeconds << Checkpoint.FileOffset << Checkpoint.CompressedSize << Checkpoint.UncompressedSize;
+	}
+};
+
+/**
+*	Lightweight match recorder for hosted sessions.
+*
+*	The game thread only serializes character state into a small buffer and queues it.
+*	A background thread batches frames into chunks, compresses them and streams them to disk.
+*	When the writer falls behind, frames are dropped instead of stalling the host.
+*/
+class FSessionReplayRecorder : public FRunnable
+{
+public:
+	/**
+	*	@param InFilename		Replay stream file, the checkpoint index is written next to it (.idx)
+	*	@param InFramesPerChunk	Number of frames compressed together, also the checkpoint interval
+	*	@param InMaxPendingBytes	Upper bound of serialized frames waiting for the writer thread
+	*/
+	FSessionReplayRecorder(const FString& InFilename, int32 InFramesPerChunk, int32 InMaxPendingBytes);
+	virtual ~FSessionReplayRecorder();
+
+	/** Opens the output file and starts the writer thread */
+	bool StartRecording();
+
+	/** Flushes remaining frames, writes the checkpoint index and joins the writer thread */
+	void StopRecording();
+
+	bool IsRecording() const { return Thread != nullptr; }
+
+	/** Serializes one frame of the world on the game thread and hands it to the writer thread */
+	void RecordFrame(UWorld* World);
+
+	/** Average game thread cost of RecordFrame in milliseconds */
+	double GetAverageRecordMs() const;
+
+	int32 GetRecordedFrames() const { return static_cast<int32>(FrameIndex); }
+	int32 GetDroppedFrames() const { return DroppedFrames; }
+	const FString& GetFilename() const { return Filename; }
+
+	//----------------------------------[ Seeking ]------------------------------------//
+
+	static FString GetIndexFilename(const FString& ReplayFilename);
+
+	/** Loads the checkpoint index written by StopRecording, or rebuilds it from the stream when there is none */
+	static bool LoadCheckpoints(const FString& ReplayFilename, TArray<FSessionReplayCheckpoint>& OutCheckpoints);
+
+	/** Scans the chunk headers of a stream whose recording was cut off, e.g. by a host crash */
+	static bool RebuildCheckpoints(const FString& ReplayFilename, TArray<FSessionReplayCheckpoint>& OutCheckpoints);
+
+	/** Returns the checkpoint to start decoding from to reach TimeSeconds, INDEX_NONE if there is none */
+	static int32 FindCheckpoint(const TArray<FSessionReplayCheckpoint>& Checkpoints, double TimeSeconds);
+
+	/** Reads and decompresses the chunk of a checkpoint. Frames are stored as [int32 Size][Size bytes] */
+	static bool ReadChunk(const FString& ReplayFilename, const FSessionReplayCheckpoint& Checkpoint, TArray<uint8>& OutFrames);
+
+protected:
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	struct FPendingFrame
+	{
+		uint32 FrameIndex;
+		double TimeSeconds;
+		TArray<uint8> Data;
+	};
+
+	void DrainQueue();
+	void FlushChunk();
+	void WriteIndex();
+
+	FString Filename;
+	int32 FramesPerChunk;
+	int32 MaxPendingBytes;
+
+	FRunnableThread* Thread = nullptr;
+	FEvent* WorkEvent = nullptr;
+	FThreadSafeBool bStopRequested;
+
+	/** Game thread -> writer thread */
+	TQueue<FPendingFrame, EQueueMode::Spsc> PendingFrames;
+	FThreadSafeCounter PendingBytes;
+
+	// Game thread only
+	uint32 FrameIndex = 0;
+	int32 DroppedFrames = 0;
+	int32 LastFrameSize = 0;
+	uint64 RecordCycles = 0;
+
+	// Writer thread only
+	TUniquePtr<IFileHandle> FileHandle;
+	TArray<uint8> ChunkBuffer;
+	TArray<uint8> CompressedBuffer;
+	TArray<uint8> ChunkHeader;
+	int32 FramesInChunk = 0;
+	FSessionReplayCheckpoint CurrentCheckpoint;
+	TArray<FSessionReplayCheckpoint> Checkpoints;
+};
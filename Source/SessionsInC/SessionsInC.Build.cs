@@ -8,7 +8,7 @@ public class SessionsInC : ModuleRules
 	{
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
-		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "EnhancedInput", "OnlineSubsystem", "OnlineSubsystemUtils" });
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "EnhancedInput", "Slate", "SlateCore", "OnlineSubsystem", "OnlineSubsystemUtils", "Json" });
 
         DynamicallyLoadedModuleNames.Add("OnlineSubsystemNull");
     }
@@ -4,4 +4,9 @@
 #include "Modules/ModuleManager.h"
 
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, SessionsInC, "SessionsInC" );
+
+DEFINE_LOG_CATEGORY(LogSessionsInC);
+
+LLM_DEFINE_TAG(SessionsInC_Session);
+LLM_DEFINE_TAG(SessionsInC_Character);
  
\ No newline at end of file
@@ -8,4 +8,11 @@
 #include "Engine.h"
 #include "Net/UnrealNetwork.h"
 #include "Online.h"
+#include "HAL/LowLevelMemTracker.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogSessionsInC, Log, All);
+
+/** Low level memory tracker tags, see "stat LLM" / -llm */
+LLM_DECLARE_TAG(SessionsInC_Session);
+LLM_DECLARE_TAG(SessionsInC_Character);
 #endif
\ No newline at end of file
@@ -1,6 +1,9 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "SessionsInCCharacter.h"
+#include "SessionsInC.h"
+#include "SessionsInCPlayerController.h"
+#include "SessionsInCCharacterMovement.h"
 #include "Engine/LocalPlayer.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
@@ -10,14 +13,32 @@
 #include "EnhancedInputComponent.h"
 #include "EnhancedInputSubsystems.h"
 #include "InputActionValue.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Misc/App.h"
 
 DEFINE_LOG_CATEGORY(LogTemplateCharacter);
 
+CSV_DEFINE_CATEGORY(SessionsInCInput, true);
+
+namespace SessionsInCInput
+{
+	/** At very low frame rates don't simulate more than this many movement steps in one frame */
+	static const int32 MaxStepsPerFrame = 16;
+
+	/** Latencies kept for the percentiles */
+	static const int32 MaxLatencySamples = 512;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // ASessionsInCCharacter
 
-ASessionsInCCharacter::ASessionsInCCharacter()
+ASessionsInCCharacter::ASessionsInCCharacter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer.SetDefaultSubobjectClass<USessionsInCCharacterMovement>(ACharacter::CharacterMovementComponentName))
 {
+	// Runs for BP_ThirdPersonCharacter on every machine. The game mode tags the whole spawn on the server,
+	// clients spawn replicated characters outside of it, so at least the components are tagged there.
+	LLM_SCOPE_BYTAG(SessionsInC_Character);
+
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(42.f, 96.0f);
 		
@@ -54,6 +75,52 @@ ASessionsInCCharacter::ASessionsInCCharacter()
 	// are set in the derived blueprint asset named ThirdPersonCharacter (to avoid direct content references in C++)
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Replication
+
+bool ASessionsInCCharacter::IsNetRelevantFor(const AActor* RealViewer, const AActor* ViewTarget, const FVector& SrcLocation) const
+{
+	const ASessionsInCPlayerController* Viewer = Cast<ASessionsInCPlayerController>(RealViewer);
+	if (Viewer && Viewer->IsJoinBootstrapping() && false == IsOwnedBy(ViewTarget) && false == IsOwnedBy(RealViewer))
+	{
+		// Nearby characters first, the rest once the ring reaches them
+		if (FVector::DistSquared(SrcLocation, GetActorLocation()) > FMath::Square(Viewer->GetJoinBootstrapRadius()))
+		{
+			return false;
+		}
+	}
+
+	return Super::IsNetRelevantFor(RealViewer, ViewTarget, SrcLocation);
+}
+
+void ASessionsInCCharacter::BeginPlay()
+{
+	// Allocations of the components' BeginPlay, also on clients
+	LLM_SCOPE_BYTAG(SessionsInC_Character);
+
+	Super::BeginPlay();
+
+	if (InputLatencyReportInterval > 0.f)
+	{
+		OnCharacterMovementUpdated.AddDynamic(this, &ASessionsInCCharacter::OnMovementApplied);
+	}
+}
+
+void ASessionsInCCharacter::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (InputLatencyReportInterval > 0.f && IsLocallyControlled())
+	{
+		InputLatencyReportElapsed += DeltaSeconds;
+		if (InputLatencyReportElapsed >= InputLatencyReportInterval)
+		{
+			InputLatencyReportElapsed = 0.f;
+			ReportInputLatency();
+		}
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Input
 
@@ -61,6 +128,8 @@ void ASessionsInCCharacter::NotifyControllerChanged()
 {
 	Super::NotifyControllerChanged();
 
+	UpdateMovementStepping();
+
 	// Add Input Mapping Context
 	if (APlayerController* PlayerController = Cast<APlayerController>(Controller))
 	{
@@ -82,6 +151,7 @@ void ASessionsInCCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInp
 
 		// Moving
 		EnhancedInputComponent->BindAction(MoveAction, ETriggerEvent::Triggered, this, &ASessionsInCCharacter::Move);
+		EnhancedInputComponent->BindAction(MoveAction, ETriggerEvent::Completed, this, &ASessionsInCCharacter::StopMove);
 
 		// Looking
 		EnhancedInputComponent->BindAction(LookAction, ETriggerEvent::Triggered, this, &ASessionsInCCharacter::Look);
@@ -97,6 +167,18 @@ void ASessionsInCCharacter::Move(const FInputActionValue& Value)
 	// input is a Vector2D
 	FVector2D MovementVector = Value.Get<FVector2D>();
 
+	// Only the start of a movement is measured, a held stick isn't new input
+	if (InputLatencyReportInterval > 0.f && HeldMoveInput.IsNearlyZero() && false == MovementVector.IsNearlyZero() && 0.0 == PendingMoveInputSeconds)
+	{
+		const ASessionsInCPlayerController* PlayerController = Cast<ASessionsInCPlayerController>(Controller);
+		if (PlayerController && PlayerController->GetInputPolledSeconds() > 0.0)
+		{
+			PendingMoveInputSeconds = PlayerController->GetInputPolledSeconds();
+			PendingMoveWindowSeconds = PlayerController->GetInputWindowStartSeconds();
+		}
+	}
+	HeldMoveInput = MovementVector;
+
 	if (Controller != nullptr)
 	{
 		// find out which way is forward
@@ -115,6 +197,13 @@ void ASessionsInCCharacter::Move(const FInputActionValue& Value)
 	}
 }
 
+void ASessionsInCCharacter::StopMove(const FInputActionValue& Value)
+{
+	HeldMoveInput = FVector2D::ZeroVector;
+	PendingMoveInputSeconds = 0.0;
+	PendingMoveWindowSeconds = 0.0;
+}
+
 void ASessionsInCCharacter::Look(const FInputActionValue& Value)
 {
 	// input is a Vector2D
@@ -127,3 +216,102 @@ void ASessionsInCCharacter::Look(const FInputActionValue& Value)
 		AddControllerPitchInput(LookAxisVector.Y);
 	}
 }
+
+//////////////////////////////////////////////////////////////////////////
+// Movement stepping and input latency
+
+void ASessionsInCCharacter::UpdateMovementStepping()
+{
+	UCharacterMovementComponent* Movement = GetCharacterMovement();
+	const UCharacterMovementComponent* Defaults = GetDefault<UCharacterMovementComponent>(Movement->GetClass());
+
+	// Controllers only exist on the server and the owning client, simulated proxies keep the defaults
+	if (bFixedStepMovement && Cast<APlayerController>(Controller))
+	{
+		Movement->MaxSimulationTimeStep = 1.f / MovementStepRate;
+		Movement->MaxSimulationIterations = FMath::Max(Defaults->MaxSimulationIterations, SessionsInCInput::MaxStepsPerFrame);
+	}
+	else
+	{
+		Movement->MaxSimulationTimeStep = Defaults->MaxSimulationTimeStep;
+		Movement->MaxSimulationIterations = Defaults->MaxSimulationIterations;
+	}
+}
+
+void ASessionsInCCharacter::AddLookInputLatency(double PolledSeconds, double WindowStartSeconds)
+{
+	if (InputLatencyReportInterval > 0.f)
+	{
+		AddInputLatency(LookLatency, PolledSeconds, WindowStartSeconds);
+	}
+}
+
+void ASessionsInCCharacter::OnMovementApplied(float DeltaSeconds, FVector OldLocation, FVector OldVelocity)
+{
+	// Motion is applied once the movement component accelerates on the input
+	if (PendingMoveInputSeconds > 0.0 && false == GetCharacterMovement()->GetCurrentAcceleration().IsNearlyZero())
+	{
+		AddInputLatency(MoveLatency, PendingMoveInputSeconds, PendingMoveWindowSeconds);
+		PendingMoveInputSeconds = 0.0;
+		PendingMoveWindowSeconds = 0.0;
+	}
+}
+
+void ASessionsInCCharacter::AddInputLatency(FInputLatencySamples& Samples, double PolledSeconds, double WindowStartSeconds)
+{
+	const double NowSeconds = FPlatformTime::Seconds();
+	const float PolledMs = static_cast<float>((NowSeconds - PolledSeconds) * 1000.0);
+	const float WindowMs = static_cast<float>((NowSeconds - FMath::Min(WindowStartSeconds, PolledSeconds)) * 1000.0);
+
+	if (Samples.PolledMs.Num() >= SessionsInCInput::MaxLatencySamples)
+	{
+		Samples.PolledMs.RemoveAt(0, 1, EAllowShrinking::No);
+		Samples.WindowMs.RemoveAt(0, 1, EAllowShrinking::No);
+	}
+	Samples.PolledMs.Add(PolledMs);
+	Samples.WindowMs.Add(WindowMs);
+
+	if (&Samples == &MoveLatency)
+	{
+		CSV_CUSTOM_STAT(SessionsInCInput, MoveInputToMotionMs, PolledMs, ECsvCustomStatOp::Set);
+		CSV_CUSTOM_STAT(SessionsInCInput, MoveInputWindowMs, WindowMs, ECsvCustomStatOp::Set);
+	}
+	else
+	{
+		CSV_CUSTOM_STAT(SessionsInCInput, LookInputToMotionMs, PolledMs, ECsvCustomStatOp::Set);
+		CSV_CUSTOM_STAT(SessionsInCInput, LookInputWindowMs, WindowMs, ECsvCustomStatOp::Set);
+	}
+}
+
+void ASessionsInCCharacter::ReportInputLatency()
+{
+	if (MoveLatency.PolledMs.Num() == 0 && LookLatency.PolledMs.Num() == 0)
+		return;
+
+	auto Summarize = [](TArray<float> Samples, float& OutMean, float& OutP95)
+	{
+		OutMean = OutP95 = 0.f;
+		if (Samples.Num() == 0)
+			return;
+
+		Samples.Sort();
+		for (float Sample : Samples)
+		{
+			OutMean += Sample;
+		}
+		OutMean /= Samples.Num();
+		OutP95 = Samples[FMath::Min(Samples.Num() - 1, FMath::FloorToInt(Samples.Num() * 0.95f))];
+	};
+
+	float MoveMean, MoveP95, MoveWindowMean, MoveWindowP95;
+	float LookMean, LookP95, LookWindowMean, LookWindowP95;
+	Summarize(MoveLatency.PolledMs, MoveMean, MoveP95);
+	Summarize(MoveLatency.WindowMs, MoveWindowMean, MoveWindowP95);
+	Summarize(LookLatency.PolledMs, LookMean, LookP95);
+	Summarize(LookLatency.WindowMs, LookWindowMean, LookWindowP95);
+
+	UE_LOG(LogTemplateCharacter, Log, TEXT("Input to motion @ %.1f FPS: move %.1f ms (p95 %.1f, from previous frame %.1f / p95 %.1f, n %d), look %.1f ms (p95 %.1f, from previous frame %.1f / p95 %.1f, n %d)")
+		, FApp::GetDeltaTime() > 0.0 ? 1.0 / FApp::GetDeltaTime() : 0.0
+		, MoveMean, MoveP95, MoveWindowMean, MoveWindowP95, MoveLatency.PolledMs.Num()
+		, LookMean, LookP95, LookWindowMean, LookWindowP95, LookLatency.PolledMs.Num());
+}
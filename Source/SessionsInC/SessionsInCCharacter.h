@@ -44,21 +44,52 @@ class ASessionsInCCharacter : public ACharacter
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AllowPrivateAccess = "true"))
 	UInputAction* LookAction;
 
+	/**
+	*	Simulate player movement in steps of at most 1 / MovementStepRate, so a long frame integrates the held input in several steps.
+	*	Applies to the owning client and to the server's copy of player controlled characters so both simulate the same steps,
+	*	simulated proxies keep the default. Server cost: a ServerMove of a 30 FPS client runs 4 steps at 120 Hz instead of 1.
+	*	Input is still read once per frame, and client and server already step the same way, so this doesn't reduce corrections.
+	*/
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AllowPrivateAccess = "true"))
+	bool bFixedStepMovement = false;
+
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AllowPrivateAccess = "true", ClampMin = "30", ClampMax = "1000"))
+	float MovementStepRate = 120.f;
+
+	/**
+	*	Seconds between input-to-motion latency reports of the local player in the log, 0 disables measuring.
+	*	Needs ASessionsInCPlayerController, which timestamps the input.
+	*/
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AllowPrivateAccess = "true"))
+	float InputLatencyReportInterval = 0.f;
+
 public:
-	ASessionsInCCharacter();
+	ASessionsInCCharacter(const FObjectInitializer& ObjectInitializer);
+
+	/** Called by the controller when UpdateRotation consumed look input, see ASessionsInCPlayerController::GetInputPolledSeconds */
+	void AddLookInputLatency(double PolledSeconds, double WindowStartSeconds);
 	
+	/** Late joiners only see characters inside their bootstrap ring until the bootstrap is done */
+	virtual bool IsNetRelevantFor(const AActor* RealViewer, const AActor* ViewTarget, const FVector& SrcLocation) const override;
+
+	virtual void Tick(float DeltaSeconds) override;
 
 protected:
 
 	/** Called for movement input */
 	void Move(const FInputActionValue& Value);
 
+	/** Called when the movement input is released */
+	void StopMove(const FInputActionValue& Value);
+
 	/** Called for looking input */
 	void Look(const FInputActionValue& Value);
 			
 
 protected:
 
+	virtual void BeginPlay() override;
+
 	virtual void NotifyControllerChanged() override;
 
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
@@ -68,5 +99,38 @@ public:
 	FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
 	/** Returns FollowCamera subobject **/
 	FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
+
+private:
+	/** Fixed movement steps for player controlled characters, the movement component's defaults otherwise */
+	void UpdateMovementStepping();
+
+	/** Bound to OnCharacterMovementUpdated, closes the move input-to-motion measurement */
+	UFUNCTION()
+	void OnMovementApplied(float DeltaSeconds, FVector OldLocation, FVector OldVelocity);
+
+	/** Recent latencies in milliseconds */
+	struct FInputLatencySamples
+	{
+		/** From the poll of the input to the frame that consumed it */
+		TArray<float> PolledMs;
+
+		/** From the previous frame's input processing, the input may have reached the OS right after that poll */
+		TArray<float> WindowMs;
+	};
+
+	void AddInputLatency(FInputLatencySamples& Samples, double PolledSeconds, double WindowStartSeconds);
+	void ReportInputLatency();
+
+	/** Latest move input, a new movement starts when it leaves zero */
+	FVector2D HeldMoveInput = FVector2D::ZeroVector;
+
+	/** Poll time of move input that hasn't become motion yet, 0 if none */
+	double PendingMoveInputSeconds = 0.0;
+	double PendingMoveWindowSeconds = 0.0;
+
+	FInputLatencySamples MoveLatency;
+	FInputLatencySamples LookLatency;
+
+	float InputLatencyReportElapsed = 0.f;
 };
 
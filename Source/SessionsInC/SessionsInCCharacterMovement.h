@@ -0,0 +1,26 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "SessionsInCCharacterMovement.generated.h"
+
+/**
+ * Character movement that keeps network statistics for benchmarking
+ */
+UCLASS()
+class USessionsInCCharacterMovement : public UCharacterMovementComponent
+{
+	GENERATED_BODY()
+
+public:
+	/** Number of position corrections this client received from the server */
+	int32 GetNumClientCorrections() const { return NumClientCorrections; }
+
+protected:
+	virtual void OnClientCorrectionReceived(class FNetworkPredictionData_Client_Character& ClientData, float TimeStamp, FVector NewLocation, FVector NewVelocity, UPrimitiveComponent* NewBase, FName NewBaseBoneName, bool bHasBase, bool bBaseRelativePosition, uint8 ServerMovementMode, FVector ServerGravityDirection) override;
+
+private:
+	int32 NumClientCorrections = 0;
+};
@@ -2,7 +2,16 @@
 
 #include "SessionsInCGameMode.h"
 #include "SessionsInCCharacter.h"
+#include "SessionsInCPlayerController.h"
+#include "GameFramework/HUD.h"
+#include "SessionsInC.h"
 #include "UObject/ConstructorHelpers.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "EngineUtils.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+CSV_DEFINE_CATEGORY(SessionsInCNet, true);
 
 ASessionsInCGameMode::ASessionsInCGameMode()
 {
@@ -12,4 +21,242 @@ ASessionsInCGameMode::ASessionsInCGameMode()
 	{
 		DefaultPawnClass = PlayerPawnBPClass.Class;
 	}
+
+	// Same HUD as BP_ThirdPersonGameMode, which ThirdPersonMap's World Settings select
+	static ConstructorHelpers::FClassFinder<AHUD> HUDBPClass(TEXT("/Game/ThirdPerson/Blueprints/BP_ThirdPersonHud"));
+	if (HUDBPClass.Class != NULL)
+	{
+		HUDClass = HUDBPClass.Class;
+	}
+
+	PlayerControllerClass = ASessionsInCPlayerController::StaticClass();
+
+	// Ticks the net governor
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+void ASessionsInCGameMode::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (bEnableNetGovernor && GetNetMode() != NM_Standalone)
+	{
+		UpdateNetGovernor(DeltaSeconds);
+	}
+}
+
+void ASessionsInCGameMode::PostLogin(APlayerController* NewPlayer)
+{
+	Super::PostLogin(NewPlayer);
+
+	// Only remote players joining an already running match need the bootstrap
+	ASessionsInCPlayerController* PlayerController = Cast<ASessionsInCPlayerController>(NewPlayer);
+	if (nullptr == PlayerController || PlayerController->IsLocalController())
+		return;
+
+	// New connections get the current bandwidth cap
+	PlayerController->ApplyNetSpeedCap(ActiveProfileIndex != INDEX_NONE ? GetScaledNetProfile().MaxClientRate : 0);
+
+	if (bLateJoinBootstrap && GetNumPlayers() > 1)
+	{
+		PlayerController->BeginJoinBootstrap(LateJoinInitialRadius, LateJoinRadiusGrowthPerSecond, LateJoinBootstrapSeconds, LateJoinNetSpeedBudget);
+	}
+}
+
+void ASessionsInCGameMode::Logout(AController* Exiting)
+{
+	if (APlayerController* PlayerController = Cast<APlayerController>(Exiting))
+	{
+		NegotiatedNetSpeeds.Remove(PlayerController->GetNetConnection());
+	}
+
+	Super::Logout(Exiting);
+}
+
+void ASessionsInCGameMode::SetPlayerDefaults(APawn* PlayerPawn)
+{
+	Super::SetPlayerDefaults(PlayerPawn);
+
+	if (PlayerPawn && ActiveProfileIndex != INDEX_NONE)
+	{
+		PlayerPawn->SetNetUpdateFrequency(GetScaledNetProfile().NetUpdateFrequency);
+	}
+}
+
+APawn* ASessionsInCGameMode::SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform)
+{
+	LLM_SCOPE_BYTAG(SessionsInC_Character);
+
+	return Super::SpawnDefaultPawnAtTransform_Implementation(NewPlayer, SpawnTransform);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Net Governor
+
+void ASessionsInCGameMode::UpdateNetGovernor(float DeltaSeconds)
+{
+	// Busy game thread time of the last frame. The frame time itself includes the idle wait of the tick rate cap or vsync.
+	const float FrameMs = FPlatformTime::ToMilliseconds(GGameThreadTime);
+	SmoothedFrameMs = SmoothedFrameMs > 0.f ? FMath::Lerp(SmoothedFrameMs, FrameMs, 0.05f) : FrameMs;
+
+	const float FrameBudgetMs = GetFrameBudgetMs();
+
+	CSV_CUSTOM_STAT(SessionsInCNet, ServerBusyMs, SmoothedFrameMs, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(SessionsInCNet, FrameBudgetMs, FrameBudgetMs, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(SessionsInCNet, Pressure, Pressure, ECsvCustomStatOp::Set);
+
+	bool bChanged = false;
+	const TCHAR* Reason = TEXT("");
+
+	// Player count, the new bracket has to be stable for GovernorHoldSeconds
+	const int32 TargetProfileIndex = FindNetProfile(GetNumPlayers());
+	if (TargetProfileIndex == ActiveProfileIndex)
+	{
+		PendingProfileIndex = INDEX_NONE;
+	}
+	else if (INDEX_NONE == ActiveProfileIndex)
+	{
+		ActiveProfileIndex = TargetProfileIndex;
+		bChanged = true;
+		Reason = TEXT("initial");
+	}
+	else
+	{
+		if (TargetProfileIndex != PendingProfileIndex)
+		{
+			PendingProfileIndex = TargetProfileIndex;
+			PendingProfileSeconds = 0.f;
+		}
+
+		PendingProfileSeconds += DeltaSeconds;
+		if (PendingProfileSeconds >= GovernorHoldSeconds)
+		{
+			ActiveProfileIndex = TargetProfileIndex;
+			PendingProfileIndex = INDEX_NONE;
+			bChanged = true;
+			Reason = TEXT("player count");
+		}
+	}
+
+	// Frame time, add pressure quickly and release it slowly
+	if (SmoothedFrameMs > FrameBudgetMs)
+	{
+		OverBudgetSeconds += DeltaSeconds;
+		UnderBudgetSeconds = 0.f;
+
+		if (OverBudgetSeconds >= GovernorHoldSeconds && Pressure < GovernorMaxPressure)
+		{
+			++Pressure;
+			OverBudgetSeconds = 0.f;
+			bChanged = true;
+			Reason = TEXT("frame time over budget");
+		}
+	}
+	// Compared against the budget of the tick rate one pressure level up, otherwise releasing pressure would put it straight back over budget
+	else if (SmoothedFrameMs < FrameBudgetMs * (Pressure > 0 ? GovernorPressureScale : 1.f) * GovernorRecoverRatio)
+	{
+		UnderBudgetSeconds += DeltaSeconds;
+		OverBudgetSeconds = 0.f;
+
+		if (UnderBudgetSeconds >= GovernorHoldSeconds * 2.f && Pressure > 0)
+		{
+			--Pressure;
+			UnderBudgetSeconds = 0.f;
+			bChanged = true;
+			Reason = TEXT("frame time recovered");
+		}
+	}
+	else
+	{
+		OverBudgetSeconds = 0.f;
+		UnderBudgetSeconds = 0.f;
+	}
+
+	if (bChanged && ActiveProfileIndex != INDEX_NONE)
+	{
+		ApplyNetProfile(Reason);
+	}
+}
+
+int32 ASessionsInCGameMode::FindNetProfile(int32 NumPlayers) const
+{
+	int32 BestIndex = INDEX_NONE;
+	for (int32 Index = 0; Index < NetProfiles.Num(); ++Index)
+	{
+		if (NetProfiles[Index].MinPlayers <= NumPlayers
+			&& (INDEX_NONE == BestIndex || NetProfiles[Index].MinPlayers > NetProfiles[BestIndex].MinPlayers))
+		{
+			BestIndex = Index;
+		}
+	}
+
+	return BestIndex;
+}
+
+float ASessionsInCGameMode::GetFrameBudgetMs() const
+{
+	int32 TickRate = 0;
+	if (ActiveProfileIndex != INDEX_NONE)
+	{
+		TickRate = GetScaledNetProfile().NetServerMaxTickRate;
+	}
+	else if (const UNetDriver* NetDriver = GetNetDriver())
+	{
+		TickRate = NetDriver->GetNetServerMaxTickRate();
+	}
+
+	return 1000.f / FMath::Max(TickRate, 1) * GovernorFrameBudgetRatio;
+}
+
+FSessionsInCNetProfile ASessionsInCGameMode::GetScaledNetProfile() const
+{
+	FSessionsInCNetProfile Profile = NetProfiles[ActiveProfileIndex];
+
+	const float Scale = FMath::Pow(GovernorPressureScale, static_cast<float>(Pressure));
+	Profile.NetServerMaxTickRate = FMath::Max(10, FMath::RoundToInt(Profile.NetServerMaxTickRate * Scale));
+	Profile.NetUpdateFrequency = FMath::Max(5.f, Profile.NetUpdateFrequency * Scale);
+
+	return Profile;
+}
+
+void ASessionsInCGameMode::ApplyNetProfile(const TCHAR* Reason)
+{
+	UNetDriver* NetDriver = GetNetDriver();
+	if (nullptr == NetDriver)
+		return;
+
+	const FSessionsInCNetProfile Profile = GetScaledNetProfile();
+
+	NetDriver->SetNetServerMaxTickRate(Profile.NetServerMaxTickRate);
+
+	for (UNetConnection* Connection : NetDriver->ClientConnections)
+	{
+		if (nullptr == Connection)
+			continue;
+
+		// Bootstrapping connections keep their budget and pick the cap up when they're done
+		if (ASessionsInCPlayerController* PlayerController = Cast<ASessionsInCPlayerController>(Connection->PlayerController))
+		{
+			PlayerController->ApplyNetSpeedCap(Profile.MaxClientRate);
+		}
+		else
+		{
+			// Capped from the negotiated rate, so a connection recovers once the profile allows more again
+			const int32 NegotiatedNetSpeed = NegotiatedNetSpeeds.FindOrAdd(Connection, Connection->CurrentNetSpeed);
+			Connection->CurrentNetSpeed = FMath::Min(NegotiatedNetSpeed, Profile.MaxClientRate);
+		}
+	}
+
+	for (TActorIterator<ASessionsInCCharacter> It(GetWorld()); It; ++It)
+	{
+		It->SetNetUpdateFrequency(Profile.NetUpdateFrequency);
+	}
+
+	++NumProfileChanges;
+
+	UE_LOG(LogSessionsInC, Log, TEXT("NetGovernor #%d (%s): players %d, busy %.2f ms, pressure %d -> profile %d, tick %d Hz, client rate %d B/s, net update %.1f Hz")
+		, NumProfileChanges, Reason, GetNumPlayers(), SmoothedFrameMs, Pressure, ActiveProfileIndex
+		, Profile.NetServerMaxTickRate, Profile.MaxClientRate, Profile.NetUpdateFrequency);
+
+	CSV_EVENT(SessionsInCNet, TEXT("NetProfile %d pressure %d (%s)"), ActiveProfileIndex, Pressure, Reason);
 }
@@ -6,13 +6,143 @@
 #include "GameFramework/GameModeBase.h"
 #include "SessionsInCGameMode.generated.h"
 
-UCLASS(minimalapi)
+class UNetConnection;
+
+/** Server network settings used while the player count is at least MinPlayers */
+USTRUCT(BlueprintType)
+struct FSessionsInCNetProfile
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	int32 MinPlayers = 0;
+
+	/** Net driver tick rate of the server */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	int32 NetServerMaxTickRate = 30;
+
+	/** Per-connection bandwidth cap in bytes per second */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	int32 MaxClientRate = 15000;
+
+	/** Net update frequency of the characters */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	float NetUpdateFrequency = 60.f;
+};
+
+UCLASS(minimalapi, config=Game)
 class ASessionsInCGameMode : public AGameModeBase
 {
 	GENERATED_BODY()
 
 public:
 	ASessionsInCGameMode();
+
+	/**
+	*	URL option that makes a listen or match URL run this game mode.
+	*	The shipped maps override the game mode in their World Settings with Blueprints based on AGameModeBase.
+	*/
+	static FString GetGameURLOption() { return FString::Printf(TEXT("game=%s"), *StaticClass()->GetPathName()); }
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	virtual void PostLogin(APlayerController* NewPlayer) override;
+
+	virtual void Logout(AController* Exiting) override;
+
+	virtual void SetPlayerDefaults(APawn* PlayerPawn) override;
+
+	/** Tags the whole spawn (actor, components and their render/physics state) as SessionsInC_Character */
+	virtual APawn* SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform) override;
+
+	//----------------------------------[ Late Join Bootstrap ]------------------------------------//
+
+	/** Stream the world progressively to players that join a match already in progress */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|LateJoin")
+	bool bLateJoinBootstrap = true;
+
+	/** Characters within this distance of the joining player are replicated first */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|LateJoin")
+	float LateJoinInitialRadius = 3000.f;
+
+	/** How fast the relevant ring grows while bootstrapping (cm per second) */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|LateJoin")
+	float LateJoinRadiusGrowthPerSecond = 6000.f;
+
+	/** After this the joining player gets normal relevancy */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|LateJoin")
+	float LateJoinBootstrapSeconds = 3.f;
+
+	/**
+	*	Cap of the joining connection's rate in bytes per second while bootstrapping, 0 to disable.
+	*	Rates are only ever lowered, so this only has an effect below the MaxClientRate of the net profiles.
+	*/
+	UPROPERTY(Config, EditAnywhere, Category = "Network|LateJoin")
+	int32 LateJoinNetSpeedBudget = 10000;
+
+	//----------------------------------[ Net Governor ]------------------------------------//
+
+	/**
+	*	Adapt tick rate, bandwidth and net update frequency to the player count and frame time.
+	*	On a multi match server all matches share the process frame rate and busy time,
+	*	every match's governor only changes the replication rate and bandwidth of its own net driver.
+	*/
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Governor")
+	bool bEnableNetGovernor = true;
+
+	/** One profile per player count bracket, the highest MinPlayers not above the player count wins */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Governor")
+	TArray<FSessionsInCNetProfile> NetProfiles;
+
+	/**
+	*	Busy game thread time above this fraction of the active tick period adds pressure, which scales the active profile down.
+	*	Measured without the idle wait, so a server capped at its tick rate isn't over budget by itself.
+	*/
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Governor", meta = (ClampMin = "0.1", ClampMax = "1.0"))
+	float GovernorFrameBudgetRatio = 0.8f;
+
+	/** Pressure is released once the busy time is below the frame budget * this */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Governor")
+	float GovernorRecoverRatio = 0.8f;
+
+	/** A condition has to hold this long before the governor acts on it */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Governor")
+	float GovernorHoldSeconds = 2.f;
+
+	/** Tick rate and net update frequency multiplier per pressure level */
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Governor")
+	float GovernorPressureScale = 0.75f;
+
+	UPROPERTY(Config, EditAnywhere, Category = "Network|Governor")
+	int32 GovernorMaxPressure = 3;
+
+private:
+	void UpdateNetGovernor(float DeltaSeconds);
+
+	/** Index of the profile for NumPlayers, INDEX_NONE if there are no profiles */
+	int32 FindNetProfile(int32 NumPlayers) const;
+
+	/** Applies the active profile scaled by the current pressure to the net driver, connections and characters */
+	void ApplyNetProfile(const TCHAR* Reason);
+
+	FSessionsInCNetProfile GetScaledNetProfile() const;
+
+	/** Busy time budget in ms, GovernorFrameBudgetRatio of the active tick period */
+	float GetFrameBudgetMs() const;
+
+	int32 ActiveProfileIndex = INDEX_NONE;
+	int32 PendingProfileIndex = INDEX_NONE;
+	float PendingProfileSeconds = 0.f;
+
+	int32 Pressure = 0;
+	float OverBudgetSeconds = 0.f;
+	float UnderBudgetSeconds = 0.f;
+	float SmoothedFrameMs = 0.f;
+
+	int32 NumProfileChanges = 0;
+
+	/** Rate negotiated at login of connections without an ASessionsInCPlayerController, the cap is applied to it */
+	TMap<TWeakObjectPtr<UNetConnection>, int32> NegotiatedNetSpeeds;
 };
 
 
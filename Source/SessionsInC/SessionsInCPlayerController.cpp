@@ -0,0 +1,205 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "SessionsInCPlayerController.h"
+#include "SessionsInC.h"
+#include "SessionsInCCharacter.h"
+#include "SessionGameInstance.h"
+#include "Engine/NetConnection.h"
+#include "Framework/Application/IInputProcessor.h"
+#include "Framework/Application/SlateApplication.h"
+
+/** Records when Slate polls input, before the player input stack of the frame processes it. Never consumes anything. */
+class FSessionsInCInputTimestamps : public IInputProcessor
+{
+public:
+	virtual void Tick(const float DeltaTime, FSlateApplication& SlateApp, TSharedRef<ICursor> Cursor) override {}
+
+	virtual bool HandleKeyDownEvent(FSlateApplication& SlateApp, const FKeyEvent& InKeyEvent) override
+	{
+		Stamp();
+		return false;
+	}
+
+	virtual bool HandleAnalogInputEvent(FSlateApplication& SlateApp, const FAnalogInputEvent& InAnalogInputEvent) override
+	{
+		if (FMath::Abs(InAnalogInputEvent.GetAnalogValue()) > KINDA_SMALL_NUMBER)
+		{
+			Stamp();
+		}
+		return false;
+	}
+
+	virtual bool HandleMouseMoveEvent(FSlateApplication& SlateApp, const FPointerEvent& MouseEvent) override
+	{
+		if (false == MouseEvent.GetCursorDelta().IsNearlyZero())
+		{
+			Stamp();
+		}
+		return false;
+	}
+
+	virtual const TCHAR* GetDebugName() const override { return TEXT("SessionsInCInputTimestamps"); }
+
+	/** Poll time of the earliest input since the last call, 0 if there was none */
+	double Consume()
+	{
+		const double Seconds = FirstInputSeconds;
+		FirstInputSeconds = 0.0;
+		return Seconds;
+	}
+
+private:
+	void Stamp()
+	{
+		if (0.0 == FirstInputSeconds)
+		{
+			FirstInputSeconds = FPlatformTime::Seconds();
+		}
+	}
+
+	double FirstInputSeconds = 0.0;
+};
+
+ASessionsInCPlayerController::ASessionsInCPlayerController()
+{
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+void ASessionsInCPlayerController::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (IsLocalPlayerController() && FSlateApplication::IsInitialized())
+	{
+		InputTimestamps = MakeShared<FSessionsInCInputTimestamps>();
+		FSlateApplication::Get().RegisterInputPreProcessor(InputTimestamps);
+	}
+}
+
+void ASessionsInCPlayerController::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (InputTimestamps.IsValid() && FSlateApplication::IsInitialized())
+	{
+		FSlateApplication::Get().UnregisterInputPreProcessor(InputTimestamps);
+	}
+	InputTimestamps.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ASessionsInCPlayerController::PlayerTick(float DeltaTime)
+{
+	// Input processed by this PlayerTick was polled earlier in the frame, and reached the OS after the previous frame's poll
+	const double NowSeconds = FPlatformTime::Seconds();
+	InputPolledSeconds = InputTimestamps.IsValid() ? InputTimestamps->Consume() : 0.0;
+	InputWindowStartSeconds = PlayerTickSeconds > 0.0 ? PlayerTickSeconds : NowSeconds;
+	PlayerTickSeconds = NowSeconds;
+
+	Super::PlayerTick(DeltaTime);
+}
+
+void ASessionsInCPlayerController::UpdateRotation(float DeltaTime)
+{
+	const bool bHasLookInput = false == RotationInput.IsNearlyZero();
+
+	Super::UpdateRotation(DeltaTime);
+
+	// The control rotation now holds this frame's look input
+	if (bHasLookInput && InputPolledSeconds > 0.0)
+	{
+		if (ASessionsInCCharacter* Character = GetPawn<ASessionsInCCharacter>())
+		{
+			Character->AddLookInputLatency(InputPolledSeconds, InputWindowStartSeconds);
+		}
+	}
+}
+
+void ASessionsInCPlayerController::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (false == bJoinBootstrapping)
+		return;
+
+	JoinBootstrapElapsed += DeltaSeconds;
+	JoinBootstrapRadius += JoinBootstrapGrowth * DeltaSeconds;
+
+	if (JoinBootstrapElapsed >= JoinBootstrapMaxSeconds)
+	{
+		EndJoinBootstrap();
+	}
+}
+
+void ASessionsInCPlayerController::BeginJoinBootstrap(float InitialRadius, float RadiusGrowthPerSecond, float MaxSeconds, int32 NetSpeedBudget)
+{
+	bJoinBootstrapping = true;
+	JoinBootstrapRadius = InitialRadius;
+	JoinBootstrapGrowth = RadiusGrowthPerSecond;
+	JoinBootstrapMaxSeconds = MaxSeconds;
+	JoinBootstrapElapsed = 0.f;
+	JoinBootstrapNetSpeedBudget = NetSpeedBudget;
+
+	ApplyNetSpeedCap(NetSpeedCap);
+
+	UE_LOG(LogSessionsInC, Log, TEXT("%s: late join bootstrap (radius %.0f, +%.0f/s, %.1f s)"), *GetName(), InitialRadius, RadiusGrowthPerSecond, MaxSeconds);
+}
+
+void ASessionsInCPlayerController::EndJoinBootstrap()
+{
+	bJoinBootstrapping = false;
+
+	// Back to the governor's current cap, which may have changed during the bootstrap
+	ApplyNetSpeedCap(NetSpeedCap);
+
+	UE_LOG(LogSessionsInC, Log, TEXT("%s: late join bootstrap finished after %.2f s"), *GetName(), JoinBootstrapElapsed);
+}
+
+void ASessionsInCPlayerController::ApplyNetSpeedCap(int32 MaxRate)
+{
+	NetSpeedCap = MaxRate;
+
+	UNetConnection* Connection = GetNetConnection();
+	if (nullptr == Connection)
+		return;
+
+	// Already clamped by the driver's MaxClientRate / MaxInternetClientRate
+	if (0 == NegotiatedNetSpeed)
+	{
+		NegotiatedNetSpeed = Connection->CurrentNetSpeed;
+	}
+
+	int32 NetSpeed = NegotiatedNetSpeed;
+	if (NetSpeedCap > 0)
+	{
+		NetSpeed = FMath::Min(NetSpeed, NetSpeedCap);
+	}
+	if (bJoinBootstrapping && JoinBootstrapNetSpeedBudget > 0)
+	{
+		NetSpeed = FMath::Min(NetSpeed, JoinBootstrapNetSpeedBudget);
+	}
+
+	Connection->CurrentNetSpeed = NetSpeed;
+}
+
+void ASessionsInCPlayerController::AcknowledgePossession(APawn* P)
+{
+	Super::AcknowledgePossession(P);
+
+	// Only the first possession after a join is time-to-playable
+	USessionGameInstance* GameInstance = GetGameInstance<USessionGameInstance>();
+	if (nullptr == GameInstance || nullptr == P)
+		return;
+
+	const float JoinSeconds = GameInstance->ConsumeJoinTravelTime();
+	if (JoinSeconds < 0.f)
+		return;
+
+	UE_LOG(LogSessionsInC, Log, TEXT("Join time-to-playable: %.3f s"), JoinSeconds);
+
+	ServerReportJoinTime(JoinSeconds);
+}
+
+void ASessionsInCPlayerController::ServerReportJoinTime_Implementation(float Seconds)
+{
+	UE_LOG(LogSessionsInC, Log, TEXT("%s: client reported join time-to-playable %.3f s"), *GetName(), Seconds);
+}
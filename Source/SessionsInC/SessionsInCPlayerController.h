@@ -0,0 +1,88 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/PlayerController.h"
+#include "SessionsInCPlayerController.generated.h"
+
+class FSessionsInCInputTimestamps;
+
+UCLASS()
+class ASessionsInCPlayerController : public APlayerController
+{
+	GENERATED_BODY()
+
+public:
+	ASessionsInCPlayerController();
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	virtual void PlayerTick(float DeltaTime) override;
+
+	/** Closes the look input-to-motion measurement of the pawn */
+	virtual void UpdateRotation(float DeltaTime) override;
+
+	/** Client reports how long it took from ClientTravel until it controlled its pawn */
+	UFUNCTION(Server, Reliable)
+	void ServerReportJoinTime(float Seconds);
+
+	//----------------------------------[ Late Join Bootstrap ]------------------------------------//
+
+	/**
+	*	Server only. Starts the late-join bootstrap for this connection:
+	*	characters close to the player become relevant first and the ring grows over time,
+	*	while the connection rate is capped so the initial burst doesn't spike the server's upload.
+	*/
+	void BeginJoinBootstrap(float InitialRadius, float RadiusGrowthPerSecond, float MaxSeconds, int32 NetSpeedBudget);
+
+	bool IsJoinBootstrapping() const { return bJoinBootstrapping; }
+
+	/** Characters further away than this are not relevant yet */
+	float GetJoinBootstrapRadius() const { return JoinBootstrapRadius; }
+
+	/**
+	*	Server only. Caps the connection rate at MaxRate (0 for no cap) on top of the bootstrap budget.
+	*	Never raises the connection above the rate it negotiated at login.
+	*/
+	void ApplyNetSpeedCap(int32 MaxRate);
+
+	//----------------------------------[ Input Latency ]------------------------------------//
+
+	/** Local only. FPlatformTime::Seconds() when Slate polled the earliest input processed this frame, 0 if there was none */
+	double GetInputPolledSeconds() const { return InputPolledSeconds; }
+
+	/** Local only. Start of this frame's PlayerTick-to-PlayerTick window, the input can't have reached the OS before that */
+	double GetInputWindowStartSeconds() const { return InputWindowStartSeconds; }
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void AcknowledgePossession(APawn* P) override;
+
+private:
+	void EndJoinBootstrap();
+
+	bool bJoinBootstrapping = false;
+	float JoinBootstrapRadius = 0.f;
+	float JoinBootstrapGrowth = 0.f;
+	float JoinBootstrapMaxSeconds = 0.f;
+	float JoinBootstrapElapsed = 0.f;
+
+	int32 JoinBootstrapNetSpeedBudget = 0;
+
+	/** Connection rate negotiated at login, before any server side cap */
+	int32 NegotiatedNetSpeed = 0;
+
+	/** Latest cap of the net governor, re-applied when the bootstrap ends */
+	int32 NetSpeedCap = 0;
+
+	/** Slate input preprocessor of the local player, stamps input as it's polled */
+	TSharedPtr<FSessionsInCInputTimestamps> InputTimestamps;
+
+	double InputPolledSeconds = 0.0;
+	double InputWindowStartSeconds = 0.0;
+	double PlayerTickSeconds = 0.0;
+};